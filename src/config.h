@@ -17,6 +17,29 @@
 
 #define MAX_FILESYSTEMS             12                                      /* The max # of filesystems drivers which can be loaded into the kernel (only at compile time for now)*/
 #define MAX_OPEN_FILES              512                                     /* Max # of open file descriptors at once */
+#define PROCESS_MAX_OPEN_FILES      64                                      /* Max # of file descriptors that each process can have open (a multiple of 32) */
+#define READDIR_BATCH_MAX           32                                      /* Max # of directory entries that one readdir system call returns */
+
+#define MAX_ATA_DISKS               4                                       /* Two ATA channels (primary and secondary), each with a master and a slave drive */
+#define MAX_VIRTIO_DISKS            4                                       /* Max # of virtio block devices that are probed on the PCI bus */
+#define MAX_RAM_DISKS               4                                       /* Max # of RAM disks (see ramdisk.h) */
+#define MAX_DISKS                   (MAX_ATA_DISKS + MAX_VIRTIO_DISKS + MAX_RAM_DISKS)    /* Every kind of disk shares the disk table */
+#define RAMDISK_IMAGE               "0:/ramdisk.img"                        /* Disk image that's loaded into a RAM disk at boot, if it exists */
+
+#define BUFFER_CACHE_BLOCKS         1024                                    /* # of sectors held by the write-back buffer cache (512 KiB) */
+#define BUFFER_CACHE_DIRTY_LIMIT    512                                     /* Dirty sectors are written back to their disks once this many accumulate */
+#define BUFFER_CACHE_HASH_BUCKETS   256                                     /* Must be a power of two */
+
+#define DISK_STREAM_RA_MIN_SECTORS  1                                       /* Read-ahead window of a disk stream after a non-sequential read */
+#define DISK_STREAM_RA_MAX_SECTORS  128                                     /* The read-ahead window doubles on sequential reads up to this cap (64 KiB) */
+#define DISK_STREAM_IOV_MAX         16                                      /* disk_stream_readv handles this many segments per disk request */
+
+#define DCACHE_ENTRIES              512                                     /* # of (directory, name) lookups remembered by the directory entry cache */
+#define DCACHE_HASH_BUCKETS         128                                     /* Must be a power of two */
+#define VNODE_HASH_BUCKETS          64                                      /* Must be a power of two */
+#define PAGE_CACHE_HASH_BUCKETS     256                                     /* Must be a power of two */
+#define FAT_DIRECTORY_CACHE_SIZE    8                                       /* # of subdirectories (with their name indexes) that a FAT filesystem keeps loaded */
+#define FAT_ALLOC_RESERVE_CLUSTERS  16                                      /* Free clusters left after a file that starts in a new place, so it can keep growing contiguously */
 
 #define TOTAL_GDT_SEGMENTS          6                                       /* The number of segments described by the GDT */
 
@@ -45,6 +68,9 @@
 #define KERNEL_DATA_SEGMENT         0x10
 
 #define PROCESS_MAX_ALLOCATIONS     1024                                    /* Max # of memory allocations that a process can make */
+#define PROCESS_MAX_MAPPINGS        16                                      /* Max # of memory mapped files (including ELF segments) that a process can have */
+#define PROCESS_MMAP_VIRT_ADDR      0x40000000                              /* Where mmap puts mappings in a process's address space, when it picks the address */
+#define PROCESS_MMAP_VIRT_ADDR_END  0x80000000
 
 #define MAX_PROCESSES               12
 
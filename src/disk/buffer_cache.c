@@ -0,0 +1,264 @@
+#include "buffer_cache.h"
+#include "memory/memory.h"
+#include "memory/heap/kernel_heap.h"
+#include "kernel.h"
+#include "config.h"
+#include "status.h"
+#include <stdbool.h>
+
+#define BUFFER_CACHE_FLUSH_RUN  128                             // Max # of contiguous dirty sectors written back with one command
+
+struct buffer_cache_block {
+        struct disk *disk;                                      // The disk this sector belongs to, or 0 if the block is unused
+        uint64_t lba;
+        bool dirty;                                             // The cached copy is newer than the copy on disk
+        char *data;                                             // DISK_SECTOR_SIZE bytes of buffer_cache_data
+
+        struct buffer_cache_block *hash_next;                   // Next block in the same hash bucket
+        struct buffer_cache_block *lru_prev;                    // Neighbor that was used more recently
+        struct buffer_cache_block *lru_next;                    // Neighbor that was used less recently
+};
+
+static struct buffer_cache_block blocks[BUFFER_CACHE_BLOCKS];
+static struct buffer_cache_block *hash_buckets[BUFFER_CACHE_HASH_BUCKETS];
+
+/* Every block is on the LRU list.  Unused blocks are at the tail so that they're handed out first. */
+static struct buffer_cache_block *lru_head;
+static struct buffer_cache_block *lru_tail;
+
+static char *buffer_cache_data;                                 // Data of every block, allocated once
+static char *flush_buffer;                                      // Holds one run of contiguous dirty sectors while it's written back
+static struct buffer_cache_block *flush_list[BUFFER_CACHE_BLOCKS];
+
+static int cached_count;                                        // # of blocks in use
+static int dirty_count;                                         // # of dirty blocks
+
+/* BUFFER_CACHE_HASH_BUCKETS must be a power of two */
+static struct buffer_cache_block **buffer_cache_bucket(struct disk *disk, uint64_t lba)
+{
+        uint32_t hash = (uint32_t)lba ^ ((uint32_t)(lba >> 32) * 31) ^ (disk->id << 16);
+        return &hash_buckets[hash & (BUFFER_CACHE_HASH_BUCKETS - 1)];
+}
+
+static void lru_unlink(struct buffer_cache_block *block)
+{
+        if (block->lru_prev)
+                block->lru_prev->lru_next = block->lru_next;
+        else
+                lru_head = block->lru_next;
+
+        if (block->lru_next)
+                block->lru_next->lru_prev = block->lru_prev;
+        else
+                lru_tail = block->lru_prev;
+
+        block->lru_prev = 0;
+        block->lru_next = 0;
+}
+
+/* Mark block as the most recently used block */
+static void lru_touch(struct buffer_cache_block *block)
+{
+        if (lru_head == block)
+                return;
+
+        lru_unlink(block);
+        block->lru_next = lru_head;
+        lru_head->lru_prev = block;
+        lru_head = block;
+}
+
+/* Returns the block caching sector lba of disk, or 0 if it isn't cached */
+static struct buffer_cache_block *buffer_cache_lookup(struct disk *disk, uint64_t lba)
+{
+        for (struct buffer_cache_block *block = *buffer_cache_bucket(disk, lba); block; block = block->hash_next) {
+                if (block->disk == disk && block->lba == lba)
+                        return block;
+        }
+
+        return 0;
+}
+
+static void buffer_cache_hash_remove(struct buffer_cache_block *block)
+{
+        struct buffer_cache_block **link = buffer_cache_bucket(block->disk, block->lba);
+        while (*link != block)
+                link = &(*link)->hash_next;
+
+        *link = block->hash_next;
+        block->hash_next = 0;
+}
+
+/* Frees up the least recently used clean block and returns it.  Returns 0 if every block is dirty. */
+static struct buffer_cache_block *buffer_cache_evict()
+{
+        for (struct buffer_cache_block *block = lru_tail; block; block = block->lru_prev) {
+                if (block->dirty)
+                        continue;
+
+                if (block->disk) {
+                        buffer_cache_hash_remove(block);
+                        block->disk = 0;
+                        cached_count--;
+                }
+                return block;
+        }
+
+        return 0;
+}
+
+void buffer_cache_init()
+{
+        memset(blocks, 0, sizeof(blocks));
+        memset(hash_buckets, 0, sizeof(hash_buckets));
+        cached_count = 0;
+        dirty_count = 0;
+
+        if (!buffer_cache_data)
+                buffer_cache_data = kzalloc(BUFFER_CACHE_BLOCKS * DISK_SECTOR_SIZE);
+        if (!flush_buffer)
+                flush_buffer = kzalloc(BUFFER_CACHE_FLUSH_RUN * DISK_SECTOR_SIZE);
+        if (!buffer_cache_data || !flush_buffer)
+                panic("buffer_cache_init: not enough memory for the buffer cache\n");
+
+        for (int i = 0; i < BUFFER_CACHE_BLOCKS; i++) {
+                blocks[i].data = buffer_cache_data + i * DISK_SECTOR_SIZE;
+                blocks[i].lru_prev = i > 0 ? &blocks[i - 1] : 0;
+                blocks[i].lru_next = i < BUFFER_CACHE_BLOCKS - 1 ? &blocks[i + 1] : 0;
+        }
+        lru_head = &blocks[0];
+        lru_tail = &blocks[BUFFER_CACHE_BLOCKS - 1];
+}
+
+/* Sorts the first n entries of flush_list by disk and then by LBA.
+ * Dirty sectors are usually written in order, so insertion sort does little work in practice.
+ */
+static void buffer_cache_sort_flush_list(int n)
+{
+        for (int i = 1; i < n; i++) {
+                struct buffer_cache_block *block = flush_list[i];
+                int j = i - 1;
+                while (j >= 0 && (flush_list[j]->disk->id > block->disk->id || 
+                                  (flush_list[j]->disk == block->disk && flush_list[j]->lba > block->lba))) {
+                        flush_list[j + 1] = flush_list[j];
+                        j--;
+                }
+                flush_list[j + 1] = block;
+        }
+}
+
+int buffer_cache_flush(struct disk *disk)
+{
+        int n = 0;
+        for (int i = 0; i < BUFFER_CACHE_BLOCKS; i++) {
+                if (blocks[i].dirty && (!disk || blocks[i].disk == disk))
+                        flush_list[n++] = &blocks[i];
+        }
+
+        buffer_cache_sort_flush_list(n);
+
+        /* Write back each run of contiguous sectors with one command */
+        int i = 0;
+        while (i < n) {
+                struct buffer_cache_block *first = flush_list[i];
+                int run = 1;
+                while (i + run < n && run < BUFFER_CACHE_FLUSH_RUN && flush_list[i + run]->disk == first->disk 
+                       && flush_list[i + run]->lba == first->lba + run) {
+                        run++;
+                }
+
+                for (int j = 0; j < run; j++)
+                        memcpy(flush_buffer + j * DISK_SECTOR_SIZE, flush_list[i + j]->data, DISK_SECTOR_SIZE);
+
+                int rc = disk_write_block_uncached(first->disk, first->lba, run, flush_buffer);
+                if (rc < 0)
+                        return rc;
+
+                for (int j = 0; j < run; j++)
+                        flush_list[i + j]->dirty = false;
+                dirty_count -= run;
+                i += run;
+        }
+
+        return 0;
+}
+
+int buffer_cache_write(struct disk *disk, uint64_t lba, int total, void *buf)
+{
+        if (disk->sector_size != DISK_SECTOR_SIZE)
+                return disk_write_block_uncached(disk, lba, total, buf);
+
+        int rc = 0;
+        for (int i = 0; i < total; i++) {
+                struct buffer_cache_block *block = buffer_cache_lookup(disk, lba + i);
+                if (!block) {
+                        block = buffer_cache_evict();
+                        if (!block)
+                                return -EIO;            // Can't happen while BUFFER_CACHE_DIRTY_LIMIT < BUFFER_CACHE_BLOCKS
+
+                        block->disk = disk;
+                        block->lba = lba + i;
+                        struct buffer_cache_block **bucket = buffer_cache_bucket(disk, block->lba);
+                        block->hash_next = *bucket;
+                        *bucket = block;
+                        cached_count++;
+                }
+
+                lru_touch(block);
+                memcpy(block->data, (char *)buf + i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
+                if (!block->dirty) {
+                        block->dirty = true;
+                        dirty_count++;
+                }
+
+                if (dirty_count >= BUFFER_CACHE_DIRTY_LIMIT) {
+                        rc = buffer_cache_flush(0);
+                        if (rc < 0)
+                                return rc;
+                }
+        }
+
+        return 0;
+}
+
+bool buffer_cache_read(struct disk *disk, uint64_t lba, int total, void *buf)
+{
+        if (total > cached_count || disk->sector_size != DISK_SECTOR_SIZE)
+                return false;
+
+        for (int i = 0; i < total; i++) {
+                if (!buffer_cache_lookup(disk, lba + i))
+                        return false;
+        }
+
+        for (int i = 0; i < total; i++) {
+                struct buffer_cache_block *block = buffer_cache_lookup(disk, lba + i);
+                lru_touch(block);
+                memcpy((char *)buf + i * DISK_SECTOR_SIZE, block->data, DISK_SECTOR_SIZE);
+        }
+
+        return true;
+}
+
+void buffer_cache_read_overlay(struct disk *disk, uint64_t lba, int total, void *buf)
+{
+        if (cached_count == 0 || disk->sector_size != DISK_SECTOR_SIZE)
+                return;
+
+        /* Look up each sector of a short read.  For a long read, it's cheaper to check every cached block. */
+        if (total <= cached_count) {
+                for (int i = 0; i < total; i++) {
+                        struct buffer_cache_block *block = buffer_cache_lookup(disk, lba + i);
+                        if (block) {
+                                lru_touch(block);
+                                memcpy((char *)buf + i * DISK_SECTOR_SIZE, block->data, DISK_SECTOR_SIZE);
+                        }
+                }
+        } else {
+                for (int i = 0; i < BUFFER_CACHE_BLOCKS; i++) {
+                        struct buffer_cache_block *block = &blocks[i];
+                        if (block->disk == disk && block->lba >= lba && block->lba < lba + total)
+                                memcpy((char *)buf + (int)(block->lba - lba) * DISK_SECTOR_SIZE, block->data, DISK_SECTOR_SIZE);
+                }
+        }
+}
@@ -0,0 +1,45 @@
+/* buffer_cache.h
+ *
+ * Write-back cache of disk sectors.
+ * Writes to a disk land here and are marked dirty instead of going straight to the drive.
+ * Dirty sectors are written back in batches: sorted by LBA, with contiguous sectors coalesced into multi-sector commands.
+ * That happens when BUFFER_CACHE_DIRTY_LIMIT dirty sectors have accumulated, or when the disk is explicitly synced (disk_sync).
+ *
+ * Sectors stay in the cache after they're written back, and they're evicted least recently used first.
+ * A cached sector is always at least as new as the copy on disk, so reads overlay cached sectors onto what they read from the drive.
+ *
+ * Only disks with DISK_SECTOR_SIZE sectors are cached.  Other disks are written through.
+ */
+
+#ifndef BUFFER_CACHE_H
+#define BUFFER_CACHE_H
+
+#include "disk.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Initialize (or reset) the buffer cache.  Any dirty data in the cache is lost. */
+void buffer_cache_init();
+
+/* Copy total sectors from buf into the cache as dirty sectors of disk, starting at lba.
+ * May write back dirty sectors of every disk if BUFFER_CACHE_DIRTY_LIMIT is reached.
+ * Returns 0 on success or < 0 on failure
+ */
+int buffer_cache_write(struct disk *disk, uint64_t lba, int total, void *buf);
+
+/* If all total sectors of disk starting at lba are cached, copy them to buf and return true.
+ * Otherwise return false without touching buf.
+ */
+bool buffer_cache_read(struct disk *disk, uint64_t lba, int total, void *buf);
+
+/* buf holds total sectors of disk starting at lba, as they were read from the drive.
+ * Replace any of them that are cached with the cached copy.
+ */
+void buffer_cache_read_overlay(struct disk *disk, uint64_t lba, int total, void *buf);
+
+/* Write back every dirty sector of disk (or of every disk if disk is 0).
+ * Returns 0 on success or < 0 on failure
+ */
+int buffer_cache_flush(struct disk *disk);
+
+#endif
@@ -1,47 +1,190 @@
 #include "io/io.h"
 #include "disk.h"
+#include "buffer_cache.h"
+#include "virtio_blk.h"
 #include "memory/memory.h"
+#include "config.h"
 #include "status.h"
 
-#define BUSY_BIT                0x0008                          // If the busy bit is set, the disk drive still has control of the command block
-#define ATA_COMMAND_IO_PORT     0x01F7
-#define ATA_DATA_PORT           0x01F0
+/* Port offsets of the ATA command block registers from a channel's io_base */
+#define ATA_REG_DATA            0x00
+#define ATA_REG_SECTOR_COUNT    0x02
+#define ATA_REG_LBA_LOW         0x03
+#define ATA_REG_LBA_MID         0x04
+#define ATA_REG_LBA_HIGH        0x05
+#define ATA_REG_DRIVE           0x06
+#define ATA_REG_STATUS          0x07                            // Reading this port returns the status register
+#define ATA_REG_COMMAND         0x07                            // Writing this port issues a command
+
+#define ATA_PRIMARY_IO_BASE             0x01F0
+#define ATA_PRIMARY_CONTROL_BASE        0x03F6
+#define ATA_SECONDARY_IO_BASE           0x0170
+#define ATA_SECONDARY_CONTROL_BASE      0x0376
+
+/* Status register bits */
+#define ATA_STATUS_ERR          0x01                            // The previous command ended in an error
+#define ATA_STATUS_DRQ          0x08                            // The drive has PIO data to transfer, or is ready to accept PIO data
+#define ATA_STATUS_DF           0x20                            // Drive fault
+#define ATA_STATUS_BSY          0x80                            // If the busy bit is set, the disk drive still has control of the command block
+#define ATA_STATUS_FLOATING     0xFF                            // Nothing is attached to the channel, so the bus floats high
+
 #define ATA_READ_SECTORS        0x0020
+#define ATA_READ_SECTORS_EXT    0x0024                          // READ SECTORS with a 48-bit LBA and 16-bit sector count
+#define ATA_WRITE_SECTORS       0x0030
+#define ATA_WRITE_SECTORS_EXT   0x0034                          // WRITE SECTORS with a 48-bit LBA and 16-bit sector count
+#define ATA_FLUSH_CACHE         0x00E7                          // Write the drive's own write cache to the media
+#define ATA_FLUSH_CACHE_EXT     0x00EA
+#define ATA_IDENTIFY_DEVICE     0x00EC
+
+#define ATA_DRIVE_LBA           0xE0                            // Bit 6 selects LBA addressing.  Bits 7 and 5 are obsolete but always set
+#define ATA_DRIVE_SLAVE         0x10
+
+#define ATA_LBA28_MAX_TRANSFER  256                             // A sector count of 0 tells the drive to transfer 256 sectors
+#define ATA_LBA48_MAX_TRANSFER  65536                           // With LBA48, a sector count of 0 tells the drive to transfer 65536 sectors
+
+#define ATA_POLL_LIMIT          1000000                         // # of status register reads before we give up on a drive
+
+/* Indexes of the IDENTIFY DEVICE words that we care about */
+#define ATA_IDENT_GENERAL_CONFIG        0                       // Bit 15 is clear for ATA devices
+#define ATA_IDENT_MAX_MULTIPLE          47                      // Bits 7:0 = max # of sectors per DRQ block for READ/WRITE MULTIPLE
+#define ATA_IDENT_LBA28_SECTORS         60                      // Words 60-61 = # of sectors addressable with a 28-bit LBA
+#define ATA_IDENT_COMMAND_SETS          83                      // Bit 10 = 48-bit address feature set supported
+#define ATA_IDENT_LBA48_SECTORS         100                     // Words 100-103 = # of sectors addressable with a 48-bit LBA
+#define ATA_IDENT_SECTOR_SIZE           106                     // Valid if bits 15:14 = 01.  Bit 12 = logical sectors are longer than 256 words
+#define ATA_IDENT_LOGICAL_SECTOR_WORDS  117                     // Words 117-118 = # of words in a logical sector
+
+#define ATA_IDENTIFY_WORDS      256
+
+/* The disk table.  Entries [0, total_disks) are initialized disks, and a disk's id is its index in this table. */
+static struct disk disks[MAX_DISKS];
+static int total_disks = 0;
+
+static unsigned char ata_status(struct ata_disk *ata)
+{
+        return insb(ata->io_base + ATA_REG_STATUS);
+}
+
+/* Drives need 400ns after being selected before their status is valid.
+ * Each read of the alternate status register takes ~100ns.
+ */
+static void ata_delay_400ns(struct ata_disk *ata)
+{
+        for (int i = 0; i < 4; i++)
+                insb(ata->control_base);
+}
+
+/* Waits for the selected drive to clear its busy bit.  Returns 0 on success or -EIO if the drive never does */
+static int ata_wait_not_busy(struct ata_disk *ata)
+{
+        for (int i = 0; i < ATA_POLL_LIMIT; i++) {
+                if (!(ata_status(ata) & ATA_STATUS_BSY))
+                        return 0;
+        }
+
+        return -EIO;
+}
+
+/* Waits for the selected drive to be ready for a PIO data transfer.
+ * Returns 0 on success or -EIO if the command failed
+ */
+static int ata_wait_drq(struct ata_disk *ata)
+{
+        for (int i = 0; i < ATA_POLL_LIMIT; i++) {
+                unsigned char status = ata_status(ata);
+                if (status & ATA_STATUS_BSY)
+                        continue;
+
+                if (status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+                        return -EIO;
+
+                if (status & ATA_STATUS_DRQ)
+                        return 0;
+        }
+
+        return -EIO;
+}
+
+/* Selects the drive described by ata.  head holds bits 24-27 of a 28-bit LBA */
+static void ata_select(struct ata_disk *ata, unsigned char head)
+{
+        outb(ata->io_base + ATA_REG_DRIVE, ATA_DRIVE_LBA | (ata->slave ? ATA_DRIVE_SLAVE : 0) | (head & 0x0F));
+}
+
+/* Programs the drive's task file registers with lba and total, then issues command.
+ * If the disk supports LBA48, the 48-bit (EXT) form of the registers is used and total may be up to ATA_LBA48_MAX_TRANSFER.
+ * Otherwise lba must fit in 28 bits and total may be up to ATA_LBA28_MAX_TRANSFER.
+ *
+ * For LBA48 each register is a two byte FIFO, so the high order bytes are written first.
+ * Returns 0 on success or < 0 on failure
+ */
+static int ata_issue_command(struct disk *disk, uint64_t lba, int total, unsigned char command)
+{
+        struct ata_disk *ata = &disk->ata;
+        int rc = ata_wait_not_busy(ata);
+        if (rc < 0)
+                return rc;
+
+        if (ata->lba48) {
+                ata_select(ata, 0);
+                outb(ata->io_base + ATA_REG_SECTOR_COUNT, (unsigned char)(total >> 8));        // Sectorcount high byte
+                outb(ata->io_base + ATA_REG_LBA_LOW, (unsigned char)(lba >> 24));             // Bits 24-31 of LBA
+                outb(ata->io_base + ATA_REG_LBA_MID, (unsigned char)(lba >> 32));             // Bits 32-39 of LBA
+                outb(ata->io_base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 40));            // Bits 40-47 of LBA
+        } else {
+                ata_select(ata, lba >> 24);                                                    // Bits 24-27 of LBA
+        }
+
+        outb(ata->io_base + ATA_REG_SECTOR_COUNT, (unsigned char)total);               // Set sectorcount
+        outb(ata->io_base + ATA_REG_LBA_LOW, (unsigned char)(lba & 0xFF));             // Set LBAlo (bits 0-7 of LBA)
+        outb(ata->io_base + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));               // Set LBAmid (bits 8-15 of LBA)
+        outb(ata->io_base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));             // Set LBAhi (bits 16 - 23 of LBA)
+        outb(ata->io_base + ATA_REG_COMMAND, command);
 
-struct disk disk;
+        return 0;
+}
+
+/* Position within a list of disk_iovec segments */
+struct disk_iov_cursor {
+        struct disk_iovec *iov;
+        int sector;                                             // Next sector within *iov
+};
+
+/* Returns the buffer for the next sector at cursor, and advances cursor past it */
+static void *disk_iov_next_sector(struct disk *disk, struct disk_iov_cursor *cursor)
+{
+        while (cursor->sector >= cursor->iov->sectors) {
+                cursor->iov++;
+                cursor->sector = 0;
+        }
+
+        return (char *)cursor->iov->buf + (cursor->sector++ << disk->sector_shift);
+}
 
 /* Read sectors at lba 
  * lba - the logical block address to read from
- * total - the number of sectors to read
- * buf - the buffer to store read data
- * 
- * I'm still somewhat unsure as to where the specification with these ports is defined.
- * I'm just using OSDev as a resource for these now.
+ * total - the number of sectors to read.  At most disk->ata.max_transfer
+ * cursor - where to store the read data.  Advanced past the sectors read
  * 
- * TODO: pull out the ports into macros
+ * Returns 0 on success or < 0 on failure
  */
-int disk_read_sector(int lba, int total, void *buf)
-{
-        outb(0x1F6, (lba >> 24) | 0xE0);                        // Select the master drive                       
-        outb(0x1F2, total);                                     // Set sectorcount
-        outb(0x1F3, (unsigned char)(lba & 0xFF));               // Set LBAlo (bits 0-7 of LBA)
-        outb(0x1F4, (unsigned char)(lba >> 8));                 // Set LBAmid (bits 8-15 of LBA)
-        outb(0x1F5, (unsigned char)(lba >> 16));                // Set LBAhi (bits 16 - 23 of LBA)
-        outb(ATA_COMMAND_IO_PORT, ATA_READ_SECTORS);            // 0x20 is read sector(s) command
+static int disk_read_sector(struct disk *disk, uint64_t lba, int total, struct disk_iov_cursor *cursor)
+{
+        struct ata_disk *ata = &disk->ata;
+        int rc = ata_issue_command(disk, lba, total, ata->lba48 ? ATA_READ_SECTORS_EXT : ATA_READ_SECTORS);
+        if (rc < 0)
+                return rc;
         
-        /* Read two bytes at a time */
-        unsigned short *ptr = (unsigned short *)buf;
         for (int i = 0; i < total; i++) {
 
                 /* Wait for the buffer to be ready */
-                char c = insb(ATA_COMMAND_IO_PORT);             // Get the status register contents
-                while(!(c & BUSY_BIT)) {        
-                        c = insb(0x1F7);
-                }
+                rc = ata_wait_drq(ata);
+                if (rc < 0)
+                        return rc;
 
-                /* Copy from the hard disk to memory */
-                for (int j = 0; j < DISK_SECTOR_SIZE / 2; j++) {
-                        *ptr = insw(ATA_DATA_PORT);
+                /* Copy from the hard disk to memory, two bytes at a time */
+                unsigned short *ptr = disk_iov_next_sector(disk, cursor);
+                for (int j = 0; j < disk->sector_size / 2; j++) {
+                        *ptr = insw(ata->io_base + ATA_REG_DATA);
                         ptr++;
                 }
 
@@ -51,31 +194,359 @@ int disk_read_sector(int lba, int total, void *buf)
         return 0;
 }
 
-/* Once our implementation can take more than one disk, 
- * this function will have to be built out
+/* Write sectors at lba
+ * lba - the logical block address to write to
+ * total - the number of sectors to write.  At most disk->ata.max_transfer
+ * cursor - the data to write.  Advanced past the sectors written
+ *
+ * Returns 0 on success or < 0 on failure
  */
+static int disk_write_sector(struct disk *disk, uint64_t lba, int total, struct disk_iov_cursor *cursor)
+{
+        struct ata_disk *ata = &disk->ata;
+        int rc = ata_issue_command(disk, lba, total, ata->lba48 ? ATA_WRITE_SECTORS_EXT : ATA_WRITE_SECTORS);
+        if (rc < 0)
+                return rc;
+
+        for (int i = 0; i < total; i++) {
+
+                /* Wait for the drive to accept the next sector */
+                rc = ata_wait_drq(ata);
+                if (rc < 0)
+                        return rc;
+
+                /* Write two bytes at a time */
+                unsigned short *ptr = disk_iov_next_sector(disk, cursor);
+                for (int j = 0; j < disk->sector_size / 2; j++) {
+                        outw(ata->io_base + ATA_REG_DATA, *ptr);
+                        ptr++;
+                }
+        }
+
+        /* The drive is busy until the last sector has been written */
+        rc = ata_wait_not_busy(ata);
+        if (rc < 0)
+                return rc;
+
+        if (ata_status(ata) & (ATA_STATUS_ERR | ATA_STATUS_DF))
+                return -EIO;
+
+        return 0;
+}
+
+/* Tell the drive to write its own write cache to the media.  Returns 0 on success or < 0 on failure */
+static int ata_flush_cache(struct disk *disk)
+{
+        struct ata_disk *ata = &disk->ata;
+        int rc = ata_wait_not_busy(ata);
+        if (rc < 0)
+                return rc;
+
+        ata_select(ata, 0);
+        outb(ata->io_base + ATA_REG_COMMAND, ata->lba48 ? ATA_FLUSH_CACHE_EXT : ATA_FLUSH_CACHE);
+
+        rc = ata_wait_not_busy(ata);
+        if (rc < 0)
+                return rc;
+
+        if (ata_status(ata) & (ATA_STATUS_ERR | ATA_STATUS_DF))
+                return -EIO;
+
+        return 0;
+}
+
+/* Issues IDENTIFY DEVICE to the drive described by disk->ata and stores the response in identify.
+ * Returns 0 on success, or -EIO if there is no ATA drive at that position (ATAPI drives abort the command)
+ */
+static int ata_identify(struct disk *disk, uint16_t *identify)
+{
+        struct ata_disk *ata = &disk->ata;
+        if (ata_status(ata) == ATA_STATUS_FLOATING)
+                return -EIO;
+
+        ata_select(ata, 0);
+        ata_delay_400ns(ata);
+
+        outb(ata->io_base + ATA_REG_SECTOR_COUNT, 0);
+        outb(ata->io_base + ATA_REG_LBA_LOW, 0);
+        outb(ata->io_base + ATA_REG_LBA_MID, 0);
+        outb(ata->io_base + ATA_REG_LBA_HIGH, 0);
+        outb(ata->io_base + ATA_REG_COMMAND, ATA_IDENTIFY_DEVICE);
+
+        /* A status of 0 means that there is no drive in this position */
+        if (ata_status(ata) == 0)
+                return -EIO;
+
+        if (ata_wait_not_busy(ata) < 0)
+                return -EIO;
+
+        /* ATAPI and SATA devices put their signature in the LBA mid and high registers instead of answering */
+        if (insb(ata->io_base + ATA_REG_LBA_MID) || insb(ata->io_base + ATA_REG_LBA_HIGH))
+                return -EIO;
+
+        if (ata_wait_drq(ata) < 0)
+                return -EIO;
+
+        for (int i = 0; i < ATA_IDENTIFY_WORDS; i++)
+                identify[i] = insw(ata->io_base + ATA_REG_DATA);
+
+        return 0;
+}
+
+/* Probes for an ATA drive at the channel and position described by disk->ata.
+ * If there is one, the rest of disk is filled in from its IDENTIFY DEVICE data.
+ * Returns 0 if a drive was found or < 0 otherwise
+ */
+static int ata_probe(struct disk *disk)
+{
+        uint16_t identify[ATA_IDENTIFY_WORDS];
+        int rc = ata_identify(disk, identify);
+        if (rc < 0)
+                return rc;
+
+        if (identify[ATA_IDENT_GENERAL_CONFIG] & 0x8000)
+                return -EIO;
+
+        struct ata_disk *ata = &disk->ata;
+        ata->lba48 = identify[ATA_IDENT_COMMAND_SETS] & (1 << 10);
+        ata->max_multiple = identify[ATA_IDENT_MAX_MULTIPLE] & 0xFF;
+        ata->max_transfer = ata->lba48 ? ATA_LBA48_MAX_TRANSFER : ATA_LBA28_MAX_TRANSFER;
+
+        disk->total_sectors = identify[ATA_IDENT_LBA28_SECTORS] | ((uint32_t)identify[ATA_IDENT_LBA28_SECTORS + 1] << 16);
+        if (ata->lba48) {
+                disk->total_sectors = 0;
+                for (int i = 3; i >= 0; i--)
+                        disk->total_sectors = (disk->total_sectors << 16) | identify[ATA_IDENT_LBA48_SECTORS + i];
+        }
+
+        disk->sector_size = DISK_SECTOR_SIZE;
+        uint16_t sector_size_info = identify[ATA_IDENT_SECTOR_SIZE];
+        if ((sector_size_info & 0xC000) == 0x4000 && (sector_size_info & (1 << 12))) {
+                disk->sector_size = 2 * (identify[ATA_IDENT_LOGICAL_SECTOR_WORDS] | 
+                                         ((uint32_t)identify[ATA_IDENT_LOGICAL_SECTOR_WORDS + 1] << 16));
+        }
+
+        /* Sector sizes are powers of two, so byte offsets can be converted to sectors with a shift */
+        disk->sector_shift = 0;
+        while ((1 << disk->sector_shift) < disk->sector_size)
+                disk->sector_shift++;
+
+        return 0;
+}
+
 void disk_search_and_init()  
 {
-        memset(&disk, 0, sizeof(struct disk));
-        disk.type = REAL;
-        disk.sector_size = DISK_SECTOR_SIZE;
-        disk.id = 0;
-        disk.filesystem = fs_resolve(&disk);
+        const unsigned short channels[][2] = {
+                { ATA_PRIMARY_IO_BASE, ATA_PRIMARY_CONTROL_BASE },
+                { ATA_SECONDARY_IO_BASE, ATA_SECONDARY_CONTROL_BASE },
+        };
+
+        memset(disks, 0, sizeof(disks));
+        total_disks = 0;
+        buffer_cache_init();
+
+        for (int channel = 0; channel < sizeof(channels) / sizeof(channels[0]); channel++) {
+                for (int slave = 0; slave < 2; slave++) {
+                        if (total_disks >= MAX_ATA_DISKS)
+                                break;
+
+                        struct disk *disk = &disks[total_disks];
+                        disk->ata.io_base = channels[channel][0];
+                        disk->ata.control_base = channels[channel][1];
+                        disk->ata.slave = slave;
+                        if (ata_probe(disk) < 0) {
+                                memset(disk, 0, sizeof(struct disk));
+                                continue;
+                        }
+
+                        disk->type = REAL;
+                        disk->id = total_disks;
+                        total_disks++;
+
+                        /* The disk must be in the table before its filesystem is resolved, since the filesystem looks it up by id */
+                        disk->filesystem = fs_resolve(disk);
+                }
+        }
+
+        virtio_blk_probe();
 }
 
-/* For now, since we only have one disk, the implementation is very basic */
 struct disk *disk_get(int index)
 {
-        if (index != 0)
+        if (index < 0 || index >= total_disks)
                 return 0;
 
-        return &disk;
+        return &disks[index];
+}
+
+/* Adds a disk of type with 512 byte sectors to the disk table.  The caller fills in the type specific data.
+ * Each kind of disk has its own limit, so that e.g. four ATA drives don't leave a boot RAM disk without a slot.
+ */
+static struct disk *disk_add(enum disk_type type, uint64_t total_sectors)
+{
+        int same_type = 0;
+        for (int i = 0; i < total_disks; i++)
+                same_type += disks[i].type == type;
+
+        if (same_type >= (type == RAM ? MAX_RAM_DISKS : MAX_VIRTIO_DISKS) || total_disks >= MAX_DISKS)
+                return 0;
+
+        struct disk *disk = &disks[total_disks];
+        memset(disk, 0, sizeof(struct disk));
+        disk->type = type;
+        disk->id = total_disks;
+        disk->sector_size = DISK_SECTOR_SIZE;
+        disk->sector_shift = 9;
+        disk->total_sectors = total_sectors;
+        total_disks++;
+        return disk;
+}
+
+struct disk *disk_add_ram(void *data, uint64_t total_sectors)
+{
+        struct disk *disk = disk_add(RAM, total_sectors);
+        if (!disk)
+                return 0;
+
+        disk->ram.data = data;
+        disk->filesystem = fs_resolve(disk);
+        return disk;
+}
+
+struct disk *disk_add_virtio(struct virtio_blk *blk, uint64_t total_sectors)
+{
+        struct disk *disk = disk_add(VIRTIO, total_sectors);
+        if (!disk)
+                return 0;
+
+        disk->virtio = blk;
+        disk->filesystem = fs_resolve(disk);
+        return disk;
+}
+
+/* Returns true if disk is an initialized entry of the disk table */
+static bool disk_valid(struct disk *disk)
+{
+        return disk && disk->id >= 0 && disk->id < total_disks && disk == &disks[disk->id];
+}
+
+/* Reads or writes (if write is set) the sectors described by iov to or from an ATA disk,
+ * splitting the transfer into commands of at most ata.max_transfer sectors
+ */
+static int ata_transfer(struct disk *disk, uint64_t lba, int total, struct disk_iovec *iov, bool write)
+{
+        struct disk_iov_cursor cursor = { .iov = iov, .sector = 0 };
+        int rc = 0;
+        while (total > 0) {
+                int count = total > disk->ata.max_transfer ? disk->ata.max_transfer : total;
+                rc = write ? disk_write_sector(disk, lba, count, &cursor) : disk_read_sector(disk, lba, count, &cursor);
+                if (rc < 0)
+                        return rc;
+
+                lba += count;
+                total -= count;
+        }
+
+        return 0;
 }
 
-int disk_read_block(struct disk *idisk, unsigned int lba, int total, void *buf)
+int disk_read_blockv(struct disk *idisk, uint64_t lba, struct disk_iovec *iov, int iovcnt)
 {
-        if (idisk != &disk)
+        if (!disk_valid(idisk))
                 return -EIO;                            // disk wasn't initialized yet
 
-        return disk_read_sector(lba, total, buf);       // eventually, disk_read_sector will take in a base port # which it acquires from disk
-}
\ No newline at end of file
+        int total = 0;
+        for (int i = 0; i < iovcnt; i++) {
+                if (iov[i].sectors < 0)
+                        return -EINVARG;
+                total += iov[i].sectors;
+        }
+
+        if (total <= 0 || lba + total > idisk->total_sectors)
+                return -EIO;
+
+        if (idisk->type == RAM) {
+                char *src = idisk->ram.data + (lba << idisk->sector_shift);
+                for (int i = 0; i < iovcnt; i++) {
+                        memcpy(iov[i].buf, src, iov[i].sectors << idisk->sector_shift);
+                        src += iov[i].sectors << idisk->sector_shift;
+                }
+                return 0;
+        }
+
+        /* Sectors that were just written (e.g. by a read-modify-write of part of a sector) are usually all still cached */
+        if (iovcnt == 1 && buffer_cache_read(idisk, lba, total, iov[0].buf))
+                return 0;
+
+        int rc = idisk->type == VIRTIO ? virtio_blk_readv(idisk->virtio, lba, iov, iovcnt) : ata_transfer(idisk, lba, total, iov, false);
+        if (rc < 0)
+                return rc;
+
+        /* Sectors that haven't been written back yet are newer in the buffer cache */
+        for (int i = 0; i < iovcnt; i++) {
+                if (iov[i].sectors > 0)
+                        buffer_cache_read_overlay(idisk, lba, iov[i].sectors, iov[i].buf);
+                lba += iov[i].sectors;
+        }
+
+        return 0;
+}
+
+int disk_read_block(struct disk *idisk, uint64_t lba, int total, void *buf)
+{
+        struct disk_iovec iov = { .buf = buf, .sectors = total };
+        return disk_read_blockv(idisk, lba, &iov, 1);
+}
+
+int disk_write_block_uncached(struct disk *idisk, uint64_t lba, int total, void *buf)
+{
+        if (!disk_valid(idisk) || idisk->type == RAM)
+                return -EIO;
+
+        if (total <= 0 || lba + total > idisk->total_sectors)
+                return -EIO;
+
+        if (idisk->type == VIRTIO)
+                return virtio_blk_write(idisk->virtio, lba, total, buf);
+
+        struct disk_iovec iov = { .buf = buf, .sectors = total };
+        return ata_transfer(idisk, lba, total, &iov, true);
+}
+
+int disk_write_block(struct disk *idisk, uint64_t lba, int total, void *buf)
+{
+        if (!disk_valid(idisk))
+                return -EIO;
+
+        if (total <= 0 || lba + total > idisk->total_sectors)
+                return -EIO;
+
+        idisk->write_generation++;
+        if (idisk->type == RAM) {
+                memcpy(idisk->ram.data + (lba << idisk->sector_shift), buf, total << idisk->sector_shift);
+                return 0;
+        }
+
+        return buffer_cache_write(idisk, lba, total, buf);
+}
+
+int disk_sync(struct disk *idisk)
+{
+        if (idisk && !disk_valid(idisk))
+                return -EIO;
+
+        int rc = buffer_cache_flush(idisk);
+        if (rc < 0)
+                return rc;
+
+        for (int i = 0; i < total_disks; i++) {
+                if ((idisk && idisk != &disks[i]) || disks[i].type == RAM)
+                        continue;
+
+                rc = disks[i].type == VIRTIO ? virtio_blk_flush(disks[i].virtio) : ata_flush_cache(&disks[i]);
+                if (rc < 0)
+                        return rc;
+        }
+
+        return 0;
+}
@@ -2,36 +2,87 @@
 #define DISK_H
 
 #include "fs/file.h"
+#include <stdint.h>
+#include <stdbool.h>
 
 #define DISK_SECTOR_SIZE        512
 
 enum disk_type {
         REAL,                           // represents real physical hard drive
+        RAM,                            // a disk whose sectors live in kernel memory
+        VIRTIO,                         // a virtio block device (paravirtualized disk)
+};
+
+struct virtio_blk;
+
+/* One segment of a vectored disk transfer: sectors whole sectors at buf */
+struct disk_iovec {
+        void *buf;
+        int sectors;
+};
+
+/* ATA (IDE) specific data of a REAL disk, most of which is reported by the IDENTIFY DEVICE command */
+struct ata_disk {
+        unsigned short io_base;         // First port of the channel's command block registers (0x1F0 primary, 0x170 secondary)
+        unsigned short control_base;    // Device control / alternate status register (0x3F6 primary, 0x376 secondary)
+        bool slave;                     // Which drive on the channel this disk is.  false = master, true = slave
+        bool lba48;                     // Drive supports the 48-bit address feature set
+        int max_multiple;               // Max # of sectors per DRQ block for READ/WRITE MULTIPLE (0 if the drive doesn't support them)
+        int max_transfer;               // Max # of sectors that one read/write command can transfer (256 for LBA28, 65536 for LBA48)
+};
+
+/* RAM specific data of a RAM disk */
+struct ram_disk {
+        char *data;                     // total_sectors * sector_size bytes holding the disk's contents
 };
 
 struct disk {
         enum disk_type type;
         int id;
         int sector_size;
+        int sector_shift;               // log2(sector_size)
+        uint64_t total_sectors;         // Capacity of the disk in sectors
         struct filesystem *filesystem;  // This is the filesystem that is bound to the disk
         void *fs_private;               // The private data of the filesystem that is bound to this disk
+        uint32_t write_generation;      // Bumped on every write, so that readers can tell when data they buffered may be stale
+
+        struct ata_disk ata;            // Valid for REAL disks
+        struct ram_disk ram;            // Valid for RAM disks
+        struct virtio_blk *virtio;      // Valid for VIRTIO disks
 };
 
 
 /* disk_search_and_init
- * Searches for disks and initializes them.
+ * Probes the master and slave drives of the primary and secondary ATA channels with IDENTIFY DEVICE,
+ * then looks for virtio block devices on the PCI bus.
+ * Each drive that responds is added to the disk table (in probe order, so the boot disk is disk 0)
+ * and bound to the filesystem that recognizes it.
  * Must be called after filesystems are initialized (fs_init())
  */
 void disk_search_and_init();
 
 /* 
  * disk_get
- * Return the disk associated with index 
+ * Return the disk associated with index, or 0 if there is no such disk
  *
  * prereq - called disk_search_and_init()
  */
 struct disk *disk_get(int index);
 
+/* disk_add_ram
+ * Adds a RAM disk to the disk table and binds it to the filesystem that recognizes it (if any).
+ * data - total_sectors * DISK_SECTOR_SIZE bytes holding the disk's contents.  The disk uses data in place
+ *
+ * Returns the new disk, or 0 if there are already MAX_RAM_DISKS RAM disks
+ */
+struct disk *disk_add_ram(void *data, uint64_t total_sectors);
+
+/* disk_add_virtio
+ * Adds the initialized virtio block device blk to the disk table and binds it to the filesystem that recognizes it (if any).
+ * Returns the new disk, or 0 if there are already MAX_VIRTIO_DISKS virtio disks
+ */
+struct disk *disk_add_virtio(struct virtio_blk *blk, uint64_t total_sectors);
+
 /*
  * disk_read_block
  * 
@@ -40,8 +91,49 @@ struct disk *disk_get(int index);
  * total - the total number of sectors to read
  * buf - output buffer to store read data
  * 
+ * RAM disks are read with a copy, and virtio disks with batches of virtqueue requests.
+ * ATA disks that support LBA48 are addressed with the 48-bit (EXT) commands, so any sector on them can be reached
+ * and up to 65536 sectors move per command.
+ * Reads larger than the disk's per-command limit are split into several commands.
+ * Returns 0 on success or < 0 on failure
+ */
+int disk_read_block(struct disk *idisk, uint64_t lba, int total, void *buf);
+
+/*
+ * disk_read_blockv
+ * Same as disk_read_block, but the contiguous sectors starting at lba are scattered across the iovcnt segments of iov, in order.
+ * The whole range is still read with as few commands as the disk allows.
+ * Returns 0 on success or < 0 on failure
+ */
+int disk_read_blockv(struct disk *idisk, uint64_t lba, struct disk_iovec *iov, int iovcnt);
+
+/*
+ * disk_write_block
+ *
+ * idisk - the disk to write to
+ * lba - the logical block address (disk sector) to start the write at
+ * total - the total number of sectors to write
+ * buf - the data to write
+ *
+ * The sectors are written to the buffer cache and reach the drive when the cache writes them back,
+ * either because too many sectors are dirty or because of disk_sync.
+ * RAM disks are written directly, since there is nothing slower behind them to cache.
+ * Returns 0 on success or < 0 on failure
+ */
+int disk_write_block(struct disk *idisk, uint64_t lba, int total, void *buf);
+
+/* Same as disk_write_block, but the sectors are written to the drive immediately, bypassing the buffer cache.
+ * Only the buffer cache should call this, since cached copies of the sectors aren't updated.
+ */
+int disk_write_block_uncached(struct disk *idisk, uint64_t lba, int total, void *buf);
+
+/*
+ * disk_sync
+ * Write back every dirty sector of idisk (or of every disk if idisk is 0) and then flush the drive's write cache,
+ * so that everything written before the call is on the media.
+ * Returns 0 on success or < 0 on failure
  */
-int disk_read_block(struct disk *idisk, unsigned int lba, int total, void *buf);
+int disk_sync(struct disk *idisk);
 
 
-#endif
\ No newline at end of file
+#endif
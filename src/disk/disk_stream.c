@@ -1,6 +1,11 @@
 #include "disk_stream.h"
 #include "memory/heap/kernel_heap.h"
 #include "disk/disk.h"
+#include "config.h"
+#include "kernel.h"
+#include "status.h"
+#include "memory/memory.h"
+#include <stdbool.h>
 
 
 struct disk_stream *get_disk_stream(int disk_index) 
@@ -10,50 +15,270 @@ struct disk_stream *get_disk_stream(int disk_index)
                 return 0;
 
         struct disk_stream *disk_stream = kzalloc(sizeof(struct disk_stream));
+        if (!disk_stream)
+                return 0;
+
+        disk_stream->ra_buffer = kzalloc(DISK_STREAM_RA_MAX_SECTORS * disk->sector_size);
+        if (!disk_stream->ra_buffer) {
+                kfree(disk_stream);
+                return 0;
+        }
+
         disk_stream->pos = 0;
         disk_stream->disk = disk;
+        disk_stream->ra_window = DISK_STREAM_RA_MIN_SECTORS;
+        disk_stream->fill_sectors = 1;
         return disk_stream;
 }
 
-int disk_stream_seek(struct disk_stream *disk_stream, int pos)
+int disk_stream_seek(struct disk_stream *disk_stream, uint64_t pos)
 {
         disk_stream->pos = pos;
         return 0;
 }
 
+int disk_stream_set_fill(struct disk_stream *disk_stream, uint64_t base_sector, int sectors)
+{
+        if (sectors <= 0 || sectors > DISK_STREAM_RA_MAX_SECTORS || (sectors & (sectors - 1)))
+                return -EINVARG;
+
+        disk_stream->fill_base = base_sector;
+        disk_stream->fill_sectors = sectors;
+        if (disk_stream->ra_window < sectors)
+                disk_stream->ra_window = sectors;
+        disk_stream_invalidate(disk_stream);
+        return 0;
+}
+
+void disk_stream_invalidate(struct disk_stream *disk_stream)
+{
+        disk_stream->ra_count = 0;
+}
+
+/* Returns a pointer to the contents of sector within the stream's read-ahead window.
+ * If sector is not in the window, the window is refilled starting at sector (or at the start of its fill unit).
+ * Returns < 0 on failure (use IS_ERROR)
+ */
+static char *disk_stream_get_sector(struct disk_stream *disk_stream, uint64_t sector)
+{
+        /* Sectors in the window may have been overwritten since it was filled */
+        if (disk_stream->ra_generation != disk_stream->disk->write_generation)
+                disk_stream->ra_count = 0;
+
+        if (disk_stream->ra_count > 0 && sector >= disk_stream->ra_lba && sector < disk_stream->ra_lba + disk_stream->ra_count)
+                return disk_stream->ra_buffer + (sector - disk_stream->ra_lba) * disk_stream->disk->sector_size;
+
+        /* A miss right at the end of the window means the stream is being read sequentially */
+        if (sector == disk_stream->ra_lba + disk_stream->ra_count) {
+                disk_stream->ra_window *= 2;
+                if (disk_stream->ra_window > DISK_STREAM_RA_MAX_SECTORS)
+                        disk_stream->ra_window = DISK_STREAM_RA_MAX_SECTORS;
+        } else {
+                disk_stream->ra_window = DISK_STREAM_RA_MIN_SECTORS;
+                if (disk_stream->ra_window < disk_stream->fill_sectors)
+                        disk_stream->ra_window = disk_stream->fill_sectors;
+        }
+
+        /* Fill the whole unit that sector is in */
+        uint64_t start = sector;
+        if (sector >= disk_stream->fill_base)
+                start -= (sector - disk_stream->fill_base) & (disk_stream->fill_sectors - 1);
+
+        /* Don't read ahead past the end of the disk */
+        int count = disk_stream->ra_window;
+        if (start < disk_stream->disk->total_sectors && start + count > disk_stream->disk->total_sectors)
+                count = disk_stream->disk->total_sectors - start;
+
+        disk_stream->ra_count = 0;
+        disk_stream->ra_generation = disk_stream->disk->write_generation;
+        int rc = disk_read_block(disk_stream->disk, start, count, disk_stream->ra_buffer);
+        if (rc < 0)
+                return ERROR(rc);
+
+        disk_stream->ra_lba = start;
+        disk_stream->ra_count = count;
+        return disk_stream->ra_buffer + (sector - start) * disk_stream->disk->sector_size;
+}
+
 int disk_stream_read(struct disk_stream *disk_stream, void *out, int total)
 {
-        int sector = disk_stream->pos / DISK_SECTOR_SIZE;
-        int offset = disk_stream->pos % DISK_SECTOR_SIZE;
-        char buf[DISK_SECTOR_SIZE];
+        struct disk *disk = disk_stream->disk;
+        int sector_size = disk->sector_size;
+        char *dest = out;
+
+        while (total > 0) {
+                uint64_t sector = disk_stream->pos >> disk->sector_shift;
+                int offset = disk_stream->pos & (sector_size - 1);
+                int count = total >> disk->sector_shift;
+
+                /* A run of whole sectors that's longer than the read-ahead window and isn't already in it
+                 * is read straight into the caller's buffer with one request.
+                 */
+                bool in_window = disk_stream->ra_count > 0 && disk_stream->ra_generation == disk->write_generation &&
+                                 sector >= disk_stream->ra_lba && sector < disk_stream->ra_lba + disk_stream->ra_count;
+                if (offset == 0 && count > disk_stream->ra_window && !in_window) {
+                        int rc = disk_read_block(disk, sector, count, dest);
+                        if (rc < 0)
+                                return rc;
 
-        int rc = disk_read_block(disk_stream->disk, sector, 1, buf);
+                        /* Keep the window's sequential detection going from the end of this run */
+                        disk_stream->ra_lba = sector + count;
+                        disk_stream->ra_count = 0;
+
+                        int bytes = count << disk->sector_shift;
+                        dest += bytes;
+                        disk_stream->pos += bytes;
+                        total -= bytes;
+                        continue;
+                }
+
+                /* Otherwise copy out of the read-ahead window, up to its end */
+                char *buf = disk_stream_get_sector(disk_stream, sector);
+                if (IS_ERROR(buf))
+                        return ERROR_I(buf);
+
+                int available = ((disk_stream->ra_lba + disk_stream->ra_count - sector) << disk->sector_shift) - offset;
+                int bytes = total < available ? total : available;
+                memcpy(dest, buf + offset, bytes);
+                dest += bytes;
+                disk_stream->pos += bytes;
+                total -= bytes;
+        }
+
+        return 0;
+}
+
+/* Returns the index of the segment of iov that holds byte rel (counted from the start of the first segment),
+ * and sets *offset to the position of that byte within the segment.  Returns iovcnt if rel is past the last segment.
+ */
+static int disk_stream_iov_locate(struct disk_stream_iovec *iov, int iovcnt, int rel, int *offset)
+{
+        int i = 0;
+        while (i < iovcnt && rel >= iov[i].len) {
+                rel -= iov[i].len;
+                i++;
+        }
+
+        *offset = rel;
+        return i;
+}
+
+/* Copies len bytes from src into the segments of iov, starting at byte rel of the segments */
+static void disk_stream_iov_scatter(struct disk_stream_iovec *iov, int iovcnt, int rel, char *src, int len)
+{
+        int offset;
+        for (int i = disk_stream_iov_locate(iov, iovcnt, rel, &offset); i < iovcnt && len > 0; i++) {
+                int bytes = iov[i].len - offset < len ? iov[i].len - offset : len;
+                memcpy((char *)iov[i].buf + offset, src, bytes);
+                src += bytes;
+                len -= bytes;
+                offset = 0;
+        }
+}
+
+/* disk_stream_readv for at most DISK_STREAM_IOV_MAX segments */
+static int disk_stream_readv_group(struct disk_stream *disk_stream, struct disk_stream_iovec *iov, int iovcnt)
+{
+        struct disk *disk = disk_stream->disk;
+        int sector_size = disk->sector_size;
+
+        int total = 0;
+        for (int i = 0; i < iovcnt; i++) {
+                if (iov[i].len < 0)
+                        return -EINVARG;
+                total += iov[i].len;
+        }
+
+        uint64_t start = disk_stream->pos;
+        uint64_t end = start + total;
+        uint64_t first_sector = start >> disk->sector_shift;
+        int sectors = ((end + sector_size - 1) >> disk->sector_shift) - first_sector;
+
+        /* Short ranges are served by the read-ahead window */
+        if (sectors <= disk_stream->ra_window) {
+                for (int i = 0; i < iovcnt; i++) {
+                        int rc = disk_stream_read(disk_stream, iov[i].buf, iov[i].len);
+                        if (rc < 0)
+                                return rc;
+                }
+                return 0;
+        }
+
+        /* Sectors that are only partly wanted, or straddle two segments, are read into ra_buffer.
+         * Each segment boundary causes at most one of them, plus one at each end of the range.
+         */
+        struct disk_iovec dio[2 * DISK_STREAM_IOV_MAX + 2];
+        uint64_t bounced[DISK_STREAM_IOV_MAX + 2];
+        int n = 0;
+        int total_bounced = 0;
+        disk_stream_invalidate(disk_stream);
+
+        uint64_t sector_pos = first_sector << disk->sector_shift;
+        while (sector_pos < end) {
+                /* Read whole sectors that lie inside one segment straight into it */
+                if (sector_pos >= start && sector_pos + sector_size <= end) {
+                        int offset;
+                        int i = disk_stream_iov_locate(iov, iovcnt, sector_pos - start, &offset);
+                        int whole = (iov[i].len - offset) >> disk->sector_shift;
+                        int left = (end - sector_pos) >> disk->sector_shift;
+                        if (whole > left)
+                                whole = left;
+
+                        if (whole > 0) {
+                                dio[n].buf = (char *)iov[i].buf + offset;
+                                dio[n].sectors = whole;
+                                n++;
+                                sector_pos += whole << disk->sector_shift;
+                                continue;
+                        }
+                }
+
+                char *bounce = disk_stream->ra_buffer + total_bounced * sector_size;
+                if (n > 0 && (char *)dio[n - 1].buf + (dio[n - 1].sectors << disk->sector_shift) == bounce) {
+                        dio[n - 1].sectors++;
+                } else {
+                        dio[n].buf = bounce;
+                        dio[n].sectors = 1;
+                        n++;
+                }
+                bounced[total_bounced++] = sector_pos;
+                sector_pos += sector_size;
+        }
+
+        int rc = disk_read_blockv(disk, first_sector, dio, n);
         if (rc < 0)
                 return rc;
-        
-        if (offset + total > DISK_SECTOR_SIZE) {
-                /* Read in until the end of the sector and recall the function */
-                for (int i = offset; i < DISK_SECTOR_SIZE; i++) {
-                        *(char *)out = buf[i];
-                        (char *)out++;
-                }
-                disk_stream->pos += DISK_SECTOR_SIZE - offset;
-                rc = disk_stream_read(disk_stream, out, total - (DISK_SECTOR_SIZE - offset));           // TODO: find a way to do this without recursion.  Uses too much stack space
+
+        for (int i = 0; i < total_bounced; i++) {
+                uint64_t from = bounced[i] > start ? bounced[i] : start;
+                uint64_t to = bounced[i] + sector_size < end ? bounced[i] + sector_size : end;
+                disk_stream_iov_scatter(iov, iovcnt, from - start, disk_stream->ra_buffer + i * sector_size + (from - bounced[i]), to - from);
+        }
+
+        /* Keep the window's sequential detection going from the end of the range */
+        disk_stream->ra_lba = end >> disk->sector_shift;
+        disk_stream->pos = end;
+        return 0;
+}
+
+int disk_stream_readv(struct disk_stream *disk_stream, struct disk_stream_iovec *iov, int iovcnt)
+{
+        while (iovcnt > 0) {
+                int count = iovcnt > DISK_STREAM_IOV_MAX ? DISK_STREAM_IOV_MAX : iovcnt;
+                int rc = disk_stream_readv_group(disk_stream, iov, count);
                 if (rc < 0)
                         return rc;
-        } else {
-                for (int i = offset; i < offset + total; i++) {
-                        *(char *)out = buf[i];
-                        (char *)out++;
-                }
-                disk_stream-> pos += total;
+
+                iov += count;
+                iovcnt -= count;
         }
-        return 0;
 
+        return 0;
 }
 
 /* Free the memory associated with disk_stream */
 void disk_stream_close (struct disk_stream *disk_stream)
 {
+        kfree(disk_stream->ra_buffer);
         kfree(disk_stream);
-}
\ No newline at end of file
+}
@@ -9,10 +9,35 @@
 #define DISK_STREAM_H
 
 #include "disk.h"
+#include <stdint.h>
 
 struct disk_stream {
-        int pos;                // The position we're at in the stream (seeking at in the disk).  The disk is linearly byte addresseable via pos
+        uint64_t pos;           // The position we're at in the stream (seeking at in the disk).  The disk is linearly byte addresseable via pos
         struct disk *disk;
+
+        /* Read-ahead window.  ra_buffer holds the sectors [ra_lba, ra_lba + ra_count).
+         * When a read misses the window at the sector directly after it, the stream is being read sequentially,
+         * so ra_window is doubled (up to DISK_STREAM_RA_MAX_SECTORS) and that many sectors are fetched with a single disk command.
+         * Any other miss resets ra_window to DISK_STREAM_RA_MIN_SECTORS.
+         * The window is discarded once the disk is written to (ra_generation != disk->write_generation).
+         */
+        char *ra_buffer;
+        uint64_t ra_lba;
+        int ra_count;
+        int ra_window;
+        uint32_t ra_generation;
+
+        /* Fill unit (see disk_stream_set_fill).  At or after fill_base, the window is filled starting on a multiple of
+         * fill_sectors and never holds less than fill_sectors, so that reads anywhere within a unit hit the window.
+         */
+        uint64_t fill_base;
+        int fill_sectors;
+};
+
+/* One destination segment of disk_stream_readv */
+struct disk_stream_iovec {
+        void *buf;
+        int len;                // In bytes
 };
 
 /* Returns a new disk stream for the disk associated with index disk_index 
@@ -23,7 +48,18 @@ struct disk_stream *get_disk_stream(int disk_index);
 /* Repositions the seeker (next byte to be read) to pos 
  * Returns 0 on success
  */
-int disk_stream_seek(struct disk_stream *disk_stream, int pos);
+int disk_stream_seek(struct disk_stream *disk_stream, uint64_t pos);
+
+/* Make the stream buffer whole units of sectors, e.g. filesystem clusters.
+ * base_sector - the first sector of the first unit.  Sectors before it aren't grouped into units
+ * sectors - # of sectors in a unit.  Must be a power of two and at most DISK_STREAM_RA_MAX_SECTORS
+ *
+ * Returns 0 on success or -EINVARG if sectors is invalid
+ */
+int disk_stream_set_fill(struct disk_stream *disk_stream, uint64_t base_sector, int sectors);
+
+/* Discard the data buffered by the stream, so the next read goes to the disk */
+void disk_stream_invalidate(struct disk_stream *disk_stream);
 
 /* Read bytes from disk stream
  * 
@@ -32,11 +68,26 @@ int disk_stream_seek(struct disk_stream *disk_stream, int pos);
  * total        - the number of bytes to read
  * 
  * side effect: increments the disk stream's pos by the number of bytes read (total)
+ *
+ * Runs of whole sectors longer than the read-ahead window are read directly into out with one request.
+ * Partial sectors at either end, and short reads, are copied out of the read-ahead window.
  * 
  * returns 0 on success or < 0 on failure
  */
 int disk_stream_read(struct disk_stream *disk_stream, void *out, int total);
 
+/* Read bytes from disk stream into several buffers
+ *
+ * Fills the iovcnt segments of iov, in order, with consecutive bytes starting at the stream's pos,
+ * and advances pos by the total length of the segments.
+ * Whole sectors that fall inside one segment are read directly into it, and the sectors of up to DISK_STREAM_IOV_MAX
+ * segments are read with a single disk_read_blockv call.  Only partial sectors at the ends and sectors that straddle
+ * two segments are bounced through the stream's buffer.
+ *
+ * returns 0 on success or < 0 on failure
+ */
+int disk_stream_readv(struct disk_stream *disk_stream, struct disk_stream_iovec *iov, int iovcnt);
+
 /* Free the memory associated with disk_stream */
 void disk_stream_close(struct disk_stream *disk_stream);
 
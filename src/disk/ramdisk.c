@@ -0,0 +1,57 @@
+#include "ramdisk.h"
+#include "fs/file.h"
+#include "memory/heap/kernel_heap.h"
+#include "print/print.h"
+#include "config.h"
+
+/* Adds the RAM disk backed by data to the disk table, or frees data if it can't be added */
+static struct disk *ramdisk_add(char *data, uint64_t total_sectors)
+{
+        struct disk *disk = disk_add_ram(data, total_sectors);
+        if (!disk) {
+                print("ramdisk: no room for another RAM disk in the disk table\n");
+                kfree(data);
+        }
+
+        return disk;
+}
+
+struct disk *ramdisk_create(uint64_t total_sectors)
+{
+        if (total_sectors == 0 || total_sectors > KERNEL_HEAP_SIZE / DISK_SECTOR_SIZE)
+                return 0;
+
+        char *data = kzalloc(total_sectors * DISK_SECTOR_SIZE);
+        if (!data)
+                return 0;
+
+        return ramdisk_add(data, total_sectors);
+}
+
+struct disk *ramdisk_load(const char *filename)
+{
+        int fd = fopen(filename, "r");
+        if (fd < 0)
+                return 0;
+
+        struct disk *disk = 0;
+        struct file_stat stat;
+        if (fstat(fd, &stat) < 0 || stat.filesize == 0 || stat.filesize > KERNEL_HEAP_SIZE)
+                goto out;
+
+        /* A trailing partial sector is zero filled */
+        uint64_t total_sectors = (stat.filesize + DISK_SECTOR_SIZE - 1) / DISK_SECTOR_SIZE;
+        char *data = kzalloc(total_sectors * DISK_SECTOR_SIZE);
+        if (!data)
+                goto out;
+
+        if (fread(data, stat.filesize, 1, fd) != 1) {
+                kfree(data);
+                goto out;
+        }
+
+        disk = ramdisk_add(data, total_sectors);
+out:
+        fclose(fd);
+        return disk;
+}
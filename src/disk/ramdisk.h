@@ -0,0 +1,26 @@
+/* ramdisk.h
+ *
+ * RAM disks are disks whose sectors live in kernel memory.
+ * They are added to the disk table like any other disk, so filesystems mount them through the usual disk API.
+ * They make fast scratch storage and a deterministic device for measuring filesystem and cache performance.
+ */
+
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "disk.h"
+#include <stdint.h>
+
+/* Create a zero filled RAM disk with total_sectors sectors.
+ * The disk has no filesystem, so it can only be used through the disk API (e.g. disk_read_block) until something formats it.
+ * Returns the new disk, or 0 on failure
+ */
+struct disk *ramdisk_create(uint64_t total_sectors);
+
+/* Create a RAM disk holding a copy of the disk image stored in the file filename (e.g. "0:/fat.img").
+ * The disk is bound to whichever filesystem recognizes the image.  The kernel loads RAMDISK_IMAGE this way at boot.
+ * Returns the new disk, or 0 on failure.  If there's no room left in the disk table, that's printed and the copy is freed.
+ */
+struct disk *ramdisk_load(const char *filename);
+
+#endif
@@ -0,0 +1,329 @@
+#include "virtio_blk.h"
+#include "pci/pci.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "memory/heap/kernel_heap.h"
+#include "config.h"
+#include "status.h"
+#include <stdbool.h>
+
+#define VIRTIO_PCI_VENDOR_ID            0x1AF4
+#define VIRTIO_PCI_DEVICE_BLK           0x1001                  // Transitional (legacy capable) block device
+
+/* Port offsets of the legacy virtio registers from BAR0 */
+#define VIRTIO_REG_DEVICE_FEATURES      0x00
+#define VIRTIO_REG_GUEST_FEATURES       0x04
+#define VIRTIO_REG_QUEUE_ADDRESS        0x08                    // Physical page number of the selected queue
+#define VIRTIO_REG_QUEUE_SIZE           0x0C
+#define VIRTIO_REG_QUEUE_SELECT         0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY         0x10
+#define VIRTIO_REG_DEVICE_STATUS        0x12
+#define VIRTIO_REG_BLK_CAPACITY         0x14                    // Block device configuration: 64-bit # of 512 byte sectors
+#define VIRTIO_REG_BLK_SIZE_MAX         0x1C                    // Max size of one data segment, if VIRTIO_BLK_F_SIZE_MAX
+
+/* Device status bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE       0x01
+#define VIRTIO_STATUS_DRIVER            0x02
+#define VIRTIO_STATUS_DRIVER_OK         0x04
+#define VIRTIO_STATUS_FAILED            0x80
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SIZE_MAX           (1 << 1)
+#define VIRTIO_BLK_F_RO                 (1 << 5)
+#define VIRTIO_BLK_F_FLUSH              (1 << 9)
+#define VIRTIO_BLK_SUPPORTED_FEATURES   (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH)
+
+#define VIRTQ_DESC_F_NEXT               0x01                    // The descriptor continues via the next field
+#define VIRTQ_DESC_F_WRITE              0x02                    // The device writes to the buffer (otherwise it reads it)
+#define VIRTQ_AVAIL_F_NO_INTERRUPT      0x01                    // Don't interrupt us when requests complete
+#define VIRTQ_ALIGN                     4096                    // The used ring of a legacy queue starts on a page boundary
+
+#define VIRTIO_BLK_T_IN                 0
+#define VIRTIO_BLK_T_OUT                1
+#define VIRTIO_BLK_T_FLUSH              4
+#define VIRTIO_BLK_S_OK                 0
+
+#define VIRTIO_BLK_DESCS_PER_REQUEST    3                       // Header, data, and status
+#define VIRTIO_BLK_MAX_REQUEST_SECTORS  256                     // Cap on the sectors moved by one request (128 KiB)
+#define VIRTIO_POLL_LIMIT               100000000               // # of used ring reads before we give up on a batch
+
+struct virtq_desc {
+        uint64_t addr;                                          // Physical address of the buffer
+        uint32_t len;
+        uint16_t flags;
+        uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail {
+        uint16_t flags;
+        uint16_t idx;                                           // Where we'll put the next entry in ring (mod queue size)
+        uint16_t ring[];                                        // Heads of descriptor chains
+} __attribute__((packed));
+
+struct virtq_used_elem {
+        uint32_t id;                                            // Head of the completed descriptor chain
+        uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used {
+        uint16_t flags;
+        uint16_t idx;                                           // Where the device will put the next entry in ring
+        struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+struct virtio_blk_request_header {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t sector;
+} __attribute__((packed));
+
+/* Device readable header and device writable status of one request */
+struct virtio_blk_request {
+        struct virtio_blk_request_header header;
+        uint8_t status;
+};
+
+struct virtio_blk {
+        unsigned short io_base;
+        bool read_only;
+        bool flush;                                             // Device supports VIRTIO_BLK_T_FLUSH
+        bool failed;                                            // A batch timed out, so the rings can't be trusted anymore
+        int max_request_sectors;
+
+        /* Request slot i always uses descriptors [3i, 3i + 2], so a batch can hold up to max_batch requests */
+        uint16_t queue_size;
+        int max_batch;
+        struct virtq_desc *desc;
+        struct virtq_avail *avail;
+        volatile struct virtq_used *used;
+        uint16_t used_idx;                                      // used->idx after the last completed batch
+        struct virtio_blk_request *requests;
+};
+
+/* Devices are few and live forever, so they're kept in a table rather than allocated one heap block each */
+static struct virtio_blk virtio_blks[MAX_VIRTIO_DISKS];
+static int total_virtio_blks = 0;
+
+static int align_up(int value, int alignment)
+{
+        return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/* Fills in request slot and its descriptors.  A count of 0 describes a request without data (a flush). */
+static void virtio_blk_prepare(struct virtio_blk *blk, int slot, uint32_t type, uint64_t lba, void *buf, int count)
+{
+        struct virtio_blk_request *request = &blk->requests[slot];
+        request->header.type = type;
+        request->header.reserved = 0;
+        request->header.sector = lba;
+        request->status = 0xFF;
+
+        int head = slot * VIRTIO_BLK_DESCS_PER_REQUEST;
+        struct virtq_desc *desc = &blk->desc[head];
+
+        /* Everything is identity mapped, so virtual addresses are physical addresses */
+        desc[0].addr = (uint32_t)&request->header;
+        desc[0].len = sizeof(struct virtio_blk_request_header);
+        desc[0].flags = VIRTQ_DESC_F_NEXT;
+        desc[0].next = head + 1;
+
+        desc[1].addr = (uint32_t)buf;
+        desc[1].len = count * DISK_SECTOR_SIZE;
+        desc[1].flags = VIRTQ_DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0);
+        desc[1].next = head + 2;
+
+        desc[2].addr = (uint32_t)&request->status;
+        desc[2].len = 1;
+        desc[2].flags = VIRTQ_DESC_F_WRITE;
+        desc[2].next = 0;
+
+        if (count == 0)
+                desc[0].next = head + 2;
+
+        blk->avail->ring[(blk->avail->idx + slot) % blk->queue_size] = head;
+}
+
+/* Makes the first total prepared request slots available to the device with a single notification,
+ * then waits for all of them to complete.
+ * If the device doesn't complete them in time, it's marked failed and refuses all later I/O: the used ring would no longer
+ * line up with the available ring, so later batches couldn't tell which of their requests had completed.
+ * Returns 0 on success or -EIO if any request failed
+ */
+static int virtio_blk_submit(struct virtio_blk *blk, int total)
+{
+        if (blk->failed)
+                return -EIO;
+
+        /* The device must see the ring entries before the new index */
+        __sync_synchronize();
+        blk->avail->idx += total;
+        __sync_synchronize();
+        outw(blk->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+
+        uint16_t done = blk->used_idx + total;
+        int polls = 0;
+        while (blk->used->idx != done) {
+                if (++polls >= VIRTIO_POLL_LIMIT) {
+                        blk->failed = true;
+                        outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, insb(blk->io_base + VIRTIO_REG_DEVICE_STATUS) | VIRTIO_STATUS_FAILED);
+                        return -EIO;
+                }
+        }
+        __sync_synchronize();
+        blk->used_idx = done;
+
+        for (int i = 0; i < total; i++) {
+                if (blk->requests[i].status != VIRTIO_BLK_S_OK)
+                        return -EIO;
+        }
+
+        return 0;
+}
+
+/* Moves the sectors starting at lba between the disk and the iovcnt segments of iov.  Each segment is split into
+ * requests of at most max_request_sectors, and up to max_batch requests (possibly from several segments) are submitted together.
+ */
+static int virtio_blk_transfer(struct virtio_blk *blk, uint32_t type, uint64_t lba, struct disk_iovec *iov, int iovcnt)
+{
+        int batch = 0;
+        for (int i = 0; i < iovcnt; i++) {
+                char *buf = iov[i].buf;
+                int total = iov[i].sectors;
+                while (total > 0) {
+                        int count = total > blk->max_request_sectors ? blk->max_request_sectors : total;
+                        virtio_blk_prepare(blk, batch, type, lba, buf, count);
+                        batch++;
+                        lba += count;
+                        total -= count;
+                        buf += count * DISK_SECTOR_SIZE;
+
+                        if (batch == blk->max_batch) {
+                                int rc = virtio_blk_submit(blk, batch);
+                                if (rc < 0)
+                                        return rc;
+                                batch = 0;
+                        }
+                }
+        }
+
+        return batch > 0 ? virtio_blk_submit(blk, batch) : 0;
+}
+
+int virtio_blk_readv(struct virtio_blk *blk, uint64_t lba, struct disk_iovec *iov, int iovcnt)
+{
+        return virtio_blk_transfer(blk, VIRTIO_BLK_T_IN, lba, iov, iovcnt);
+}
+
+int virtio_blk_write(struct virtio_blk *blk, uint64_t lba, int total, void *buf)
+{
+        if (blk->read_only)
+                return -EIO;
+
+        struct disk_iovec iov = { .buf = buf, .sectors = total };
+        return virtio_blk_transfer(blk, VIRTIO_BLK_T_OUT, lba, &iov, 1);
+}
+
+int virtio_blk_flush(struct virtio_blk *blk)
+{
+        if (!blk->flush)
+                return 0;                                       // The device has no write cache
+
+        virtio_blk_prepare(blk, 0, VIRTIO_BLK_T_FLUSH, 0, 0, 0);
+        return virtio_blk_submit(blk, 1);
+}
+
+/* Sets up queue 0 (the only queue of a block device).  Returns 0 on success or < 0 on failure */
+static int virtio_blk_init_queue(struct virtio_blk *blk)
+{
+        outw(blk->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+        blk->queue_size = insw(blk->io_base + VIRTIO_REG_QUEUE_SIZE);
+        if (blk->queue_size < VIRTIO_BLK_DESCS_PER_REQUEST)
+                return -EIO;
+
+        /* Legacy layout: descriptor table and available ring, then the used ring on the next page boundary.
+         * Heap allocations are page aligned.
+         */
+        int avail_offset = sizeof(struct virtq_desc) * blk->queue_size;
+        int used_offset = align_up(avail_offset + sizeof(struct virtq_avail) + sizeof(uint16_t) * (blk->queue_size + 1), VIRTQ_ALIGN);
+        int size = used_offset + align_up(sizeof(struct virtq_used) + sizeof(struct virtq_used_elem) * blk->queue_size + sizeof(uint16_t), VIRTQ_ALIGN);
+        char *queue = kzalloc(size);
+        if (!queue)
+                return -ENOMEM;
+
+        blk->max_batch = blk->queue_size / VIRTIO_BLK_DESCS_PER_REQUEST;
+        blk->requests = kzalloc(sizeof(struct virtio_blk_request) * blk->max_batch);
+        if (!blk->requests) {
+                kfree(queue);
+                return -ENOMEM;
+        }
+
+        blk->desc = (struct virtq_desc *)queue;
+        blk->avail = (struct virtq_avail *)(queue + avail_offset);
+        blk->used = (struct virtq_used *)(queue + used_offset);
+        blk->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+        blk->used_idx = 0;
+
+        outl(blk->io_base + VIRTIO_REG_QUEUE_ADDRESS, (uint32_t)queue / VIRTQ_ALIGN);
+        return 0;
+}
+
+/* Brings up the device behind pci_device.  Returns 0 on success or < 0 on failure */
+static int virtio_blk_init(struct virtio_blk *blk, struct pci_device *pci_device, uint64_t *total_sectors)
+{
+        uint32_t bar = pci_read_bar(pci_device, 0);
+        if (!(bar & PCI_BAR_IO_SPACE))
+                return -EIO;
+
+        memset(blk, 0, sizeof(struct virtio_blk));
+        blk->io_base = bar & ~0x3;
+        pci_enable(pci_device, PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER);
+
+        /* Reset the device, then tell it that we found it and know how to drive it */
+        outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+        outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+        outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+        uint32_t features = insl(blk->io_base + VIRTIO_REG_DEVICE_FEATURES) & VIRTIO_BLK_SUPPORTED_FEATURES;
+        outl(blk->io_base + VIRTIO_REG_GUEST_FEATURES, features);
+        blk->read_only = features & VIRTIO_BLK_F_RO;
+        blk->flush = features & VIRTIO_BLK_F_FLUSH;
+
+        blk->max_request_sectors = VIRTIO_BLK_MAX_REQUEST_SECTORS;
+        if (features & VIRTIO_BLK_F_SIZE_MAX) {
+                int size_max_sectors = insl(blk->io_base + VIRTIO_REG_BLK_SIZE_MAX) / DISK_SECTOR_SIZE;
+                if (size_max_sectors > 0 && size_max_sectors < blk->max_request_sectors)
+                        blk->max_request_sectors = size_max_sectors;
+        }
+
+        *total_sectors = insl(blk->io_base + VIRTIO_REG_BLK_CAPACITY) | 
+                         ((uint64_t)insl(blk->io_base + VIRTIO_REG_BLK_CAPACITY + 4) << 32);
+
+        int rc = virtio_blk_init_queue(blk);
+        if (rc < 0) {
+                outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+                return rc;
+        }
+
+        outb(blk->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+        return 0;
+}
+
+void virtio_blk_probe()
+{
+        struct pci_device pci_device;
+        total_virtio_blks = 0;
+        for (int index = 0; total_virtio_blks < MAX_VIRTIO_DISKS; index++) {
+                if (pci_find_device(VIRTIO_PCI_VENDOR_ID, VIRTIO_PCI_DEVICE_BLK, index, &pci_device) < 0)
+                        return;
+
+                struct virtio_blk *blk = &virtio_blks[total_virtio_blks];
+                uint64_t total_sectors;
+                if (virtio_blk_init(blk, &pci_device, &total_sectors) < 0)
+                        continue;
+
+                if (!disk_add_virtio(blk, total_sectors))
+                        return;                                 // No more virtio disks fit in the disk table
+
+                total_virtio_blks++;
+        }
+}
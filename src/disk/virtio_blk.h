@@ -0,0 +1,31 @@
+/* virtio_blk.h
+ *
+ * Driver for virtio block devices (virtio-blk-pci in QEMU), using the legacy virtio PCI interface.
+ * Requests are described in a virtqueue shared with the device.  A whole batch of requests is queued
+ * before the device is notified, so a large transfer costs a single notification (VM exit) instead of
+ * one port access per word like ATA PIO.
+ *
+ * Interrupts aren't used.  The driver polls the used ring until the device has completed the batch.
+ */
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "disk.h"
+#include <stdint.h>
+
+struct virtio_blk;
+
+/* Finds every virtio block device on the PCI bus, initializes it, and adds it to the disk table */
+void virtio_blk_probe();
+
+/* Read the sectors starting at lba into the iovcnt segments of iov, in order.  Returns 0 on success or < 0 on failure */
+int virtio_blk_readv(struct virtio_blk *blk, uint64_t lba, struct disk_iovec *iov, int iovcnt);
+
+/* Write total sectors from buf starting at lba.  Returns 0 on success or < 0 on failure */
+int virtio_blk_write(struct virtio_blk *blk, uint64_t lba, int total, void *buf);
+
+/* Wait for the device to commit completed writes to stable storage.  Returns 0 on success or < 0 on failure */
+int virtio_blk_flush(struct virtio_blk *blk);
+
+#endif
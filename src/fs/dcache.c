@@ -0,0 +1,170 @@
+#include "dcache.h"
+#include "memory/memory.h"
+#include "string/string.h"
+#include "config.h"
+
+static struct dentry dentries[DCACHE_ENTRIES];
+static struct dentry *hash_buckets[DCACHE_HASH_BUCKETS];
+
+/* Every entry is on the LRU list.  Unused entries are at the tail so that they're handed out first. */
+static struct dentry *lru_head;
+static struct dentry *lru_tail;
+
+/* DCACHE_HASH_BUCKETS must be a power of two.  The name is hashed ignoring case since names are compared ignoring case. */
+static struct dentry **dcache_bucket(struct disk *disk, uint32_t parent, const char *name)
+{
+        uint32_t hash = parent * 31 ^ (disk->id << 16);
+        while (*name) {
+                hash = hash * 31 + (unsigned char)tolower(*name);
+                name++;
+        }
+
+        return &hash_buckets[hash & (DCACHE_HASH_BUCKETS - 1)];
+}
+
+static void lru_unlink(struct dentry *dentry)
+{
+        if (dentry->lru_prev)
+                dentry->lru_prev->lru_next = dentry->lru_next;
+        else
+                lru_head = dentry->lru_next;
+
+        if (dentry->lru_next)
+                dentry->lru_next->lru_prev = dentry->lru_prev;
+        else
+                lru_tail = dentry->lru_prev;
+
+        dentry->lru_prev = 0;
+        dentry->lru_next = 0;
+}
+
+/* Mark dentry as the most recently used entry */
+static void lru_touch(struct dentry *dentry)
+{
+        if (lru_head == dentry)
+                return;
+
+        lru_unlink(dentry);
+        dentry->lru_next = lru_head;
+        lru_head->lru_prev = dentry;
+        lru_head = dentry;
+}
+
+/* Move dentry to the tail of the LRU list so that it's reused first */
+static void lru_demote(struct dentry *dentry)
+{
+        if (lru_tail == dentry)
+                return;
+
+        lru_unlink(dentry);
+        dentry->lru_prev = lru_tail;
+        lru_tail->lru_next = dentry;
+        lru_tail = dentry;
+}
+
+static void dcache_hash_remove(struct dentry *dentry)
+{
+        struct dentry **link = dcache_bucket(dentry->disk, dentry->parent, dentry->name);
+        while (*link != dentry)
+                link = &(*link)->hash_next;
+
+        *link = dentry->hash_next;
+        dentry->hash_next = 0;
+}
+
+/* Removes dentry from the cache, leaving it unused */
+static void dcache_drop(struct dentry *dentry)
+{
+        dcache_hash_remove(dentry);
+        dentry->disk = 0;
+        lru_demote(dentry);
+}
+
+void dcache_init()
+{
+        memset(dentries, 0, sizeof(dentries));
+        memset(hash_buckets, 0, sizeof(hash_buckets));
+
+        for (int i = 0; i < DCACHE_ENTRIES; i++) {
+                dentries[i].lru_prev = i > 0 ? &dentries[i - 1] : 0;
+                dentries[i].lru_next = i < DCACHE_ENTRIES - 1 ? &dentries[i + 1] : 0;
+        }
+        lru_head = &dentries[0];
+        lru_tail = &dentries[DCACHE_ENTRIES - 1];
+}
+
+/* Returns the entry caching name in directory parent of disk, or 0 if it isn't cached */
+static struct dentry *dcache_find(struct disk *disk, uint32_t parent, const char *name)
+{
+        for (struct dentry *dentry = *dcache_bucket(disk, parent, name); dentry; dentry = dentry->hash_next) {
+                if (dentry->disk == disk && dentry->parent == parent && strnicmp(dentry->name, name, DENTRY_NAME_MAX) == 0)
+                        return dentry;
+        }
+
+        return 0;
+}
+
+struct dentry *dcache_lookup(struct disk *disk, uint32_t parent, const char *name)
+{
+        if (strnlen(name, DENTRY_NAME_MAX) == DENTRY_NAME_MAX)
+                return 0;
+
+        struct dentry *dentry = dcache_find(disk, parent, name);
+        if (dentry)
+                lru_touch(dentry);
+
+        return dentry;
+}
+
+void dcache_insert(struct disk *disk, uint32_t parent, const char *name, const void *data, int size)
+{
+        if (strnlen(name, DENTRY_NAME_MAX) == DENTRY_NAME_MAX || size > DENTRY_DATA_SIZE)
+                return;
+
+        struct dentry *dentry = dcache_find(disk, parent, name);
+        if (!dentry) {
+                dentry = lru_tail;
+                if (dentry->disk)
+                        dcache_drop(dentry);
+
+                dentry->disk = disk;
+                dentry->parent = parent;
+                strncpy(dentry->name, name, DENTRY_NAME_MAX);
+                struct dentry **bucket = dcache_bucket(disk, parent, name);
+                dentry->hash_next = *bucket;
+                *bucket = dentry;
+        }
+
+        dentry->negative = !data;
+        memset(dentry->data, 0, DENTRY_DATA_SIZE);
+        if (data)
+                memcpy(dentry->data, (void *)data, size);
+
+        lru_touch(dentry);
+}
+
+void dcache_invalidate(struct disk *disk, uint32_t parent, const char *name)
+{
+        if (strnlen(name, DENTRY_NAME_MAX) == DENTRY_NAME_MAX)
+                return;
+
+        struct dentry *dentry = dcache_find(disk, parent, name);
+        if (dentry)
+                dcache_drop(dentry);
+}
+
+void dcache_invalidate_directory(struct disk *disk, uint32_t parent)
+{
+        for (int i = 0; i < DCACHE_ENTRIES; i++) {
+                if (dentries[i].disk == disk && dentries[i].parent == parent)
+                        dcache_drop(&dentries[i]);
+        }
+}
+
+void dcache_invalidate_disk(struct disk *disk)
+{
+        for (int i = 0; i < DCACHE_ENTRIES; i++) {
+                if (dentries[i].disk && (!disk || dentries[i].disk == disk))
+                        dcache_drop(&dentries[i]);
+        }
+}
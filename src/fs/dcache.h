@@ -0,0 +1,60 @@
+/* dcache.h
+ *
+ * Directory entry cache.
+ * Remembers the result of looking up a name in a directory so that resolving the same path again doesn't have to
+ * read and search the directory.  Entries are keyed by (disk, parent directory, name).
+ *
+ * The parent directory is identified by a filesystem specific number (e.g. its first cluster), and the cached data is
+ * a filesystem specific blob (e.g. the on-disk directory entry) of at most DENTRY_DATA_SIZE bytes.
+ * Names that were looked up and don't exist are cached too (negative entries), so repeated misses are also free.
+ *
+ * Names are compared ignoring case.  When the cache is full, the least recently used entry is replaced.
+ * Filesystems that modify directories must invalidate the entries they change.
+ */
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "disk/disk.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DENTRY_NAME_MAX         64                              // Longer names are never cached
+#define DENTRY_DATA_SIZE        56                              // Large enough for a FAT directory entry and its location
+
+struct dentry {
+        struct disk *disk;                                      // The disk this entry belongs to, or 0 if the entry is unused
+        uint32_t parent;                                        // Identifies the directory that was searched
+        char name[DENTRY_NAME_MAX];
+        bool negative;                                          // name doesn't exist in parent.  data is unused.
+        char data[DENTRY_DATA_SIZE];
+
+        struct dentry *hash_next;                               // Next entry in the same hash bucket
+        struct dentry *lru_prev;                                // Neighbor that was used more recently
+        struct dentry *lru_next;                                // Neighbor that was used less recently
+};
+
+/* Initialize (or reset) the directory entry cache */
+void dcache_init();
+
+/* Returns the cached entry for name in directory parent of disk, or 0 if the lookup isn't cached.
+ * The returned entry may be negative.  It is only valid until the next call to dcache_insert.
+ */
+struct dentry *dcache_lookup(struct disk *disk, uint32_t parent, const char *name);
+
+/* Caches the result of looking up name in directory parent of disk.
+ * data points to size bytes of filesystem data describing the entry, or is 0 if name doesn't exist (negative entry).
+ * Does nothing if name is too long or size is larger than DENTRY_DATA_SIZE.
+ */
+void dcache_insert(struct disk *disk, uint32_t parent, const char *name, const void *data, int size);
+
+/* Drops the cached lookup of name in directory parent of disk, if any */
+void dcache_invalidate(struct disk *disk, uint32_t parent, const char *name);
+
+/* Drops every cached lookup in directory parent of disk */
+void dcache_invalidate_directory(struct disk *disk, uint32_t parent);
+
+/* Drops every cached lookup of disk (or of every disk if disk is 0) */
+void dcache_invalidate_disk(struct disk *disk);
+
+#endif
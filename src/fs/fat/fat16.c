@@ -2,17 +2,36 @@
 #include "status.h"
 #include "string/string.h"
 #include "disk/disk_stream.h"
+#include "fs/dcache.h"
+#include "fs/vnode.h"
 #include "memory/memory.h"
 #include "memory/heap/kernel_heap.h"
 #include "kernel.h"
 #include "config.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #define FAT16_SIGNATURE         0x29
 #define FAT16_FAT_ENTRY_SIZE    0x02                    // In bytes
-#define FAT16_BAD_SECTOR        0xFFF7
+#define FAT32_FAT_ENTRY_SIZE    0x04                    // In bytes
+#define FAT32_ENTRY_MASK        0x0FFFFFFF              // FAT32 entries are 28 bits.  The top 4 bits are reserved and must be preserved.
 #define FAT16_UNUSED            0x00
+#define FAT_END_OF_CHAIN        0xFFFFFFFF              // Written to the FAT entry of the last cluster in a chain (truncated to the FAT's entry width)
+#define FAT32_MIRRORING_DISABLED        0x80            // fat32 header flag: only the FAT numbered by the low 4 bits is in use
+#define FAT32_FSINFO_LEAD_SIGNATURE     0x41615252
+#define FAT32_FSINFO_STRUCT_SIGNATURE   0x61417272
+#define FAT32_FSINFO_UNKNOWN            0xFFFFFFFF      // An FSInfo free count or next free cluster that isn't known
+#define FAT_DELETED_ENTRY       0xE5                    // First filename byte of a free directory entry
+#define FAT_83_NAME_LEN         11                      // Length of a directory entry's name and extension fields
+#define FAT_LFN_ATTRIBUTE       0x0F                    // Attribute of a VFAT long file name entry (read only, hidden, system and volume label)
+#define FAT_LFN_LAST_ENTRY      0x40                    // Set in the ordinal of the long file name entry that holds the end of the name
+#define FAT_LFN_ORDINAL_MASK    0x3F
+#define FAT_LFN_CHARS_PER_ENTRY 13                      // UCS-2 characters in each long file name entry
+#define FAT_LFN_MAX_ENTRIES     20                      // A long file name is at most 255 characters
+#define FAT_LFN_UTF8_SIZE(entries)      ((entries) * FAT_LFN_CHARS_PER_ENTRY * 3 + 1)   // Room for a long name as UTF-8 (each UCS-2 character takes at most 3 bytes)
+#define FAT_DIRECTORY_INDEX_MIN_SLOTS   16              // Must be a power of two
+#define FAT_EXTENTS_MIN_CAPACITY        8               // Extent lists that grow start out with room for this many extents
 
 /* FAT directory entry attribute byte bitmasks */
 #define FAT_FILE_READ_ONLY      0x01                    // If this bit is set, the operating system will not allow a file to be opened for modification. 
@@ -61,11 +80,46 @@ struct fat_header_primary {
         uint32_t sectors_big;                           // This field states the total number of sectors in the volume
 } __attribute__((packed));
 
+/* FAT32 BIOS Parameter Block fields.  On FAT32 volumes, these come between the primary header and the extended header. */
+struct fat32_header {
+        uint32_t sectors_per_fat;                       // # of sectors occupied by one copy of the FAT.  The primary header's sectors_per_fat is 0.
+        uint16_t flags;                                 // Bits 0 - 3 = the active FAT if bit 7 (FAT32_MIRRORING_DISABLED) is set
+        uint16_t version;
+        uint32_t root_cluster;                          // The root directory is a cluster chain that starts here
+        uint16_t fsinfo_sector;                         // Sector of the FSInfo structure, within the reserved region
+        uint16_t backup_boot_sector;
+        uint8_t reserved[12];
+} __attribute__((packed));
+
 struct fat_header {
         struct fat_header_primary fat_header_primary;
-        struct fat_header_extended fat_header_extended;
+        union {
+                struct fat_header_extended fat_header_extended;                 // FAT16
+                struct {
+                        struct fat32_header fat32_header;
+                        struct fat_header_extended fat32_header_extended;
+                } __attribute__((packed));
+        };
 } __attribute__((packed));
 
+/* The FAT32 FSInfo sector, which remembers the free cluster count and where free clusters were last found.
+ * Both are only hints: they may be out of date if the volume was last used by a driver that didn't update them.
+ */
+struct fat32_fsinfo {
+        uint32_t lead_signature;                        // FAT32_FSINFO_LEAD_SIGNATURE
+        uint8_t reserved[480];
+        uint32_t struct_signature;                      // FAT32_FSINFO_STRUCT_SIGNATURE
+        uint32_t free_count;                            // Last known # of free clusters, or FAT32_FSINFO_UNKNOWN
+        uint32_t next_free;                             // Cluster to start looking for free clusters at, or FAT32_FSINFO_UNKNOWN
+        uint8_t reserved2[12];
+        uint32_t trail_signature;
+} __attribute__((packed));
+
+enum fat_type {
+        FAT_TYPE_16,
+        FAT_TYPE_32
+};
+
 struct fat_directory_entry {
         uint8_t filename[8];                            // Must be trailing padded.  Allowed characters are alphanumeric only
         uint8_t ext[3];                                 // Same requirements as filename
@@ -82,14 +136,88 @@ struct fat_directory_entry {
         uint32_t filesize;                              // This 32-bit field count the total file size in bytes. For this reason the file system driver must not allow more than 4 Gb to be allocated to a file. For other entries than files then file size field should be set to 0.
 } __attribute__((packed));
 
-/* fat_directory corresponds to a directory cluster and represents a directory in our filesystem
+/* A VFAT long file name entry.  A long name is stored in a run of these right before the 8.3 entry of the file,
+ * the end of the name first.  Each one holds the checksum of the 8.3 name so that a stale run can be told apart.
+ */
+struct fat_long_name_entry {
+        uint8_t ordinal;                                // Position of this piece of the name, counting from 1.  FAT_LFN_LAST_ENTRY marks the last piece.
+        uint16_t name1[5];
+        uint8_t attribute;                              // Always FAT_LFN_ATTRIBUTE
+        uint8_t type;
+        uint8_t checksum;                               // Checksum of the 8.3 name (fat16_short_name_checksum)
+        uint16_t name2[6];
+        uint16_t first_cluster;                         // Always 0
+        uint16_t name3[2];
+} __attribute__((packed));
+
+/* A slot of a directory's name index.  Every named entry has a slot for its 8.3 name, and another for its long name if it has one. */
+struct fat_index_slot {
+        uint32_t hash;                                  // Hash of the entry's normalized 8.3 name, or of its long name
+        uint32_t entry;                                 // The entry's index in the directory + 1, or 0 if the slot is empty
+        uint32_t long_name;                             // For a long name slot, the offset of the name in the directory's long_names + 1.  0 for an 8.3 name slot.
+        uint32_t long_name_entries;                     // # of long file name entries in front of the entry
+};
+
+/* fat_directory represents a directory in our filesystem
  * It doesn't directly correspond to an on-disk data structure.  This struct just makes it easier for us to manage things internally
+ * The entries themselves stay on disk and are read with a fat_directory_iterator.  Only the name index is kept in memory.
  */
 struct fat_directory {
-        struct fat_directory_entry *entry;              // Points to the first directory entry in the directory that this struct represents
-        int total;                                      // Total number of entries in the directory
-        int sector;                                     // The first disk sector where this directory cluster is located
-        int end_sector;                                 // The last disk sector that contains this directory cluster
+        int total;                                      // # of entries before the end of directory marker (including free entries)
+        int sector;                                     // The first disk sector of the directory
+        int end_sector;                                 // For the root directory, the first sector after it (where the data region starts)
+        uint32_t cluster;                               // The directory's first cluster, or 0 for the root directory
+
+        /* Hash index of the entries' 8.3 names, built when the directory is loaded.
+         * An open addressing table of index_mask + 1 slots that is kept at most half full.
+         */
+        struct fat_index_slot *index;
+        int index_mask;
+        int index_count;                                // # of used slots
+
+        /* Long file names decoded (as UTF-8) when the directory was loaded, one after another, each followed by a null byte.
+         * Lookups compare against these, so long name entries are only decoded once.
+         */
+        char *long_names;
+        int long_names_size;
+        int long_names_capacity;
+};
+
+/* Reads the entries of a directory one at a time through the directory stream, following the directory's cluster chain.
+ * On FAT16, the root directory isn't a cluster chain.  It's a fixed size region in front of the data region.
+ */
+struct fat_directory_iterator {
+        struct disk *disk;
+        uint32_t first_cluster;                         // The directory's first cluster, or 0 for the FAT16 root directory
+        uint32_t cluster;                               // The cluster that holds entry pos
+        uint32_t cluster_first_pos;                     // Index of the first entry in cluster
+        uint32_t pos;                                   // Index of the next entry to read
+        uint64_t entry_pos;                             // Disk position of the entry that was read (or of the end of directory marker) last
+        bool at_end_marker;                             // The last read stopped at the end of directory marker
+};
+
+/* A directory entry that was looked up, and where it lives.  This is what the dcache holds for FAT lookups. */
+struct fat_dentry {
+        struct fat_directory_entry entry;
+        uint64_t entry_pos;                             // Absolute position of entry on disk
+        uint32_t parent;                                // First cluster of the directory holding entry, or 0 for the root directory
+        uint32_t index;                                 // Index of entry in its directory
+        uint32_t long_name_entries;                     // # of long file name entries in front of entry
+};
+
+/* State of decoding a long file name while the entries of a directory are read in order */
+struct fat_long_name_decoder {
+        uint16_t chars[FAT_LFN_MAX_ENTRIES * FAT_LFN_CHARS_PER_ENTRY];
+        int entries;                                    // # of entries in the long name being decoded, or 0 if there's none
+        int next;                                       // Ordinal of the entry expected next.  0 once the whole name has been read.
+        uint8_t checksum;
+};
+
+/* An open directory stream.  Entries are read from disk as they're asked for, so each batch continues where the last one stopped. */
+struct fat_directory_stream {
+        struct fat_directory_iterator it;
+        struct fat_long_name_decoder decoder;
+        char long_name[FAT_LFN_UTF8_SIZE(FAT_LFN_MAX_ENTRIES)];
 };
 
 /* This structure is meant to make dealing with directory entries simpler.  In the case where the entry we're working with
@@ -107,10 +235,50 @@ struct fat_easy_directory_entry {
         enum fat_dir_entry_type type;
 };
 
+/* A run of physically contiguous clusters in a file's cluster chain */
+struct fat_extent {
+        uint32_t file_cluster;                                  // Index of the run's first cluster within the file
+        uint32_t cluster;                                       // The run's first cluster on disk
+        uint32_t count;                                         // # of clusters in the run
+};
+
+/* The state of an open file that's shared by every descriptor open on it.  It's the private data of the file's vnode,
+ * which is keyed by entry_pos.
+ */
+struct fat_file {
+        struct fat_easy_directory_entry *easy_directory_entry;  // The directory entry corresponding to the open file                 
+        uint32_t parent;                                        // First cluster of the directory holding the file's entry, or 0 for the root directory
+        uint64_t entry_pos;                                     // Absolute position of the file's directory entry on disk
+        uint32_t index;                                         // Index of the file's directory entry in its directory
+        uint32_t long_name_entries;                             // # of long file name entries in front of the file's directory entry
+
+        /* The file's cluster chain as extents sorted by file_cluster, built when the file is opened */
+        struct fat_extent *extents;
+        int total_extents;
+        int extents_capacity;                                   // # of extents that fit in the extents allocation
+
+        uint32_t next_cluster_hint;                             // Where the file's next cluster should go (just past its last run), or 0 if it hasn't been worked out
+};
+
 /* Represents an open file */
 struct fat_file_descriptor {
-        struct fat_easy_directory_entry *easy_directory_entry;  // The directory entry corresponding to the open file                 
+        struct vnode *vnode;                                    // Shared with every other descriptor open on the same file
+        struct fat_file *file;                                  // vnode->private
         uint32_t pos;                                           // Current stream offset into file
+        enum file_mode mode;
+        bool written;                                           // Set once the descriptor has changed the file, so closing it syncs the disk
+};
+
+/* Where things are on a FAT volume, worked out once when it's resolved.
+ * Cluster sizes are powers of two, so turning a file or directory offset into a disk position only takes shifts and masks.
+ */
+struct fat_layout {
+        uint32_t fat_lba;                               // First sector of the first FAT
+        uint32_t data_lba;                              // First sector of the data region, where cluster 2 starts
+        int cluster_shift;                              // log2(sectors per cluster)
+        int cluster_bytes_shift;                        // log2(bytes per cluster)
+        uint32_t cluster_mask;                          // Bytes per cluster - 1.  Masks a byte offset down to its offset in its cluster.
+        uint32_t cluster_size;                          // Bytes per cluster
 };
 
 /* Private data for internal use by FAT filesystem 
@@ -118,22 +286,70 @@ struct fat_file_descriptor {
  */
 struct fat_private {
         struct fat_header header;
+        enum fat_type type;
+        uint32_t sectors_per_fat;                       // From the FAT16 or the FAT32 header
+        struct fat_layout layout;
+
+        /* The root directory is always known by cluster 0 (which is also what ".." entries hold for it).
+         * On FAT32 it's really a cluster chain starting at root_cluster.  On FAT16 root_cluster is 0.
+         */
         struct fat_directory root_directory;
+        uint32_t root_cluster;
 
-        /* Three separate stream structures but all point to the same disk 
+        /* Separate stream structures but all point to the same disk 
          * that is associated with this fat filesystem.
          */
         struct disk_stream *cluster_read_stream;                // Used to stream file data from data clusters
-        struct disk_stream *fat_read_stream;                    // Used to stream the file allocation table (FAT)
         struct disk_stream *directory_stream;                   // Used to stream directory clusters
+
+        /* The file allocation table (FAT), loaded when the disk is resolved so that walking a cluster chain doesn't touch the disk.
+         * It's kept in its on-disk form (16 or 32-bit entries) so that changed sectors can be written straight back.
+         */
+        void *fat_table;
+        int fat_table_entries;
+        int fat_entry_size;                             // FAT16_FAT_ENTRY_SIZE or FAT32_FAT_ENTRY_SIZE
+        int fat_first_copy;                             // The FAT that's read, and the first one that's written
+        int fat_mirrors;                                // # of FAT copies, starting at fat_first_copy, that changes are written to
+
+        /* The FSInfo sector of a FAT32 volume, or 0 if there's none.  Its hints are refreshed whenever the FAT is written back. */
+        uint32_t fsinfo_sector;
+        struct fat32_fsinfo fsinfo;
+
+        /* Recently used subdirectories (and their name indexes), most recently used first */
+        struct fat_directory *directory_cache[FAT_DIRECTORY_CACHE_SIZE];
+
+        /* Changes to fat_table are written back to the disk's FATs at the end of each operation, a whole run of changed sectors at a time.
+         * fat_dirty has a byte for each FAT sector that is nonzero if the sector has changed.
+         */
+        uint8_t *fat_dirty;
+
+        /* Free-cluster bitmap, built from the FAT when the disk is resolved.  Bit n is set if cluster n is free. */
+        uint32_t *free_bitmap;
+        int total_clusters;                                     // Clusters 2 through total_clusters - 1 exist
+        int free_clusters;
+        int alloc_rover;                                        // Where the search for a free run starts when a file has no hint.  Kept past the last new run's reservation.
+
+        char *sector_buffer;                                    // One sector, for partial sector writes
 };
 
 int fat16_resolve(struct disk *disk);
-void *fat16_open(struct disk *disk, struct path_part *path_part, enum file_mode mode);
+int fat32_resolve(struct disk *disk);
+static int fat16_build_directory_index(struct disk *disk, struct fat_directory *directory);
+static int fat16_write_bytes(struct disk *disk, uint64_t pos, uint32_t n, const char *in);
+void *fat16_fopen(struct disk *disk, struct path_part *path_part, enum file_mode mode);
 size_t fat16_fread(struct disk *disk, void *descriptor, size_t size, size_t nmemb, char *out);
 int fat16_fseek(void *private, size_t offset, enum file_seek_mode whence);
 int fat16_fstat(struct disk *disk, void *private, struct file_stat *stat);
 int fat16_fclose(void *private);
+size_t fat16_fwrite(struct disk *disk, void *descriptor, size_t size, size_t nmemb, const char *in);
+int fat16_ftruncate(struct disk *disk, void *private, size_t length);
+int fat16_create(struct disk *disk, struct path_part *path);
+int fat16_unlink(struct disk *disk, struct path_part *path);
+void *fat16_opendir(struct disk *disk, struct path_part *path);
+int fat16_readdir(struct disk *disk, void *private, struct dirent *entries, int max);
+int fat16_closedir(void *private);
+void *fat16_fdup(struct disk *disk, void *private);
+struct vnode *fat16_vnode(void *private);
 
 struct filesystem fat16_fs = {
         .resolve = fat16_resolve,
@@ -141,7 +357,35 @@ struct filesystem fat16_fs = {
         .fs_fread = fat16_fread,
         .fs_fseek = fat16_fseek,
         .fs_fstat = fat16_fstat,
-        .fs_fclose = fat16_fclose
+        .fs_fclose = fat16_fclose,
+        .fs_fwrite = fat16_fwrite,
+        .fs_ftruncate = fat16_ftruncate,
+        .fs_create = fat16_create,
+        .fs_unlink = fat16_unlink,
+        .fs_opendir = fat16_opendir,
+        .fs_readdir = fat16_readdir,
+        .fs_closedir = fat16_closedir,
+        .fs_dup = fat16_fdup,
+        .fs_vnode = fat16_vnode
+};
+
+/* FAT32 volumes are handled by the same driver.  Only resolve differs. */
+struct filesystem fat32_fs = {
+        .resolve = fat32_resolve,
+        .fs_open = fat16_fopen,
+        .fs_fread = fat16_fread,
+        .fs_fseek = fat16_fseek,
+        .fs_fstat = fat16_fstat,
+        .fs_fclose = fat16_fclose,
+        .fs_fwrite = fat16_fwrite,
+        .fs_ftruncate = fat16_ftruncate,
+        .fs_create = fat16_create,
+        .fs_unlink = fat16_unlink,
+        .fs_opendir = fat16_opendir,
+        .fs_readdir = fat16_readdir,
+        .fs_closedir = fat16_closedir,
+        .fs_dup = fat16_fdup,
+        .fs_vnode = fat16_vnode
 };
 
 struct filesystem *fat16_init()
@@ -150,190 +394,570 @@ struct filesystem *fat16_init()
         return &fat16_fs;
 }
 
+struct filesystem *fat32_init()
+{
+        strcpy(fat32_fs.name, "FAT32");
+        return &fat32_fs;
+}
+
 /* Initializes the filesystem's internal private data structures */
 static void fat16_init_private(struct disk *disk, struct fat_private *fat_private)
 {
         memset(fat_private, 0, sizeof(struct fat_private));
         fat_private->cluster_read_stream = get_disk_stream(disk->id);
-        fat_private->fat_read_stream = get_disk_stream(disk->id);
         fat_private->directory_stream = get_disk_stream(disk->id);
 }
 
+/* Frees the allocated memory associated with directory */
+static void fat16_free_directory(struct fat_directory *directory)
+{
+        if (!directory)
+                return;
+
+        if (directory->index)
+                kfree(directory->index);
+        if (directory->long_names)
+                kfree(directory->long_names);
+
+        kfree(directory);
+}
+
+/* Frees fat_private and the streams it owns */
+static void fat16_free_private(struct fat_private *fat_private)
+{
+        if (fat_private->cluster_read_stream)
+                disk_stream_close(fat_private->cluster_read_stream);
+        if (fat_private->directory_stream)
+                disk_stream_close(fat_private->directory_stream);
+        if (fat_private->root_directory.index)
+                kfree(fat_private->root_directory.index);
+        if (fat_private->root_directory.long_names)
+                kfree(fat_private->root_directory.long_names);
+        for (int i = 0; i < FAT_DIRECTORY_CACHE_SIZE; i++)
+                fat16_free_directory(fat_private->directory_cache[i]);
+        if (fat_private->fat_table)
+                kfree(fat_private->fat_table);
+        if (fat_private->fat_dirty)
+                kfree(fat_private->fat_dirty);
+        if (fat_private->free_bitmap)
+                kfree(fat_private->free_bitmap);
+        if (fat_private->sector_buffer)
+                kfree(fat_private->sector_buffer);
+
+        kfree(fat_private);
+}
+
 /* Returns the absolute position of sector on disk 
  * "Absolute position" refers to the byte offset of sector from the start of the disk
  * Sector is a 0-based index.  I.e. sector 0 starts at byte 0, sector 1 starts at byte 512, etc.
  */
-static int fat16_sector_to_absolute_pos(struct disk *disk, int sector)
+static uint64_t fat16_sector_to_absolute_pos(struct disk *disk, uint64_t sector)
 {
-        return sector * disk->sector_size;
+        return sector << disk->sector_shift;
 }
 
-/* Return the number of directory entries in the directory cluster that starts at directory_start_sector 
- * Returns < 0 if an error occurs
+/* Writes the normalized form of name to out: the FAT_83_NAME_LEN byte on-disk 8.3 form (name and extension padded with spaces), in lower case.
+ * Returns 0 on success or -EINVARG if name can't be an 8.3 name
  */
-static int fat16_get_total_items_for_directory(struct disk *disk, uint32_t directory_start_sector)
+static int fat16_normalize_name(const char *name, char *out)
 {
-        int rc = 0;
+        memset(out, ' ', FAT_83_NAME_LEN);
 
-        struct fat_directory_entry entry;
-        memset(&entry, 0, sizeof(struct fat_directory_entry));
+        /* The "." and ".." entries aren't split into a name and an extension */
+        if (strncmp(name, ".", 2) == 0 || strncmp(name, "..", 3) == 0) {
+                memcpy(out, (void *)name, strlen(name));
+                return 0;
+        }
 
-        int directory_start_pos = fat16_sector_to_absolute_pos(disk, directory_start_sector);
-        struct fat_private *fat_private = disk->fs_private;
-        struct disk_stream *directory_stream = fat_private->directory_stream;
-        if ((rc = disk_stream_seek(directory_stream, directory_start_pos)) < 0) {
-                return rc;
+        int i = 0;
+        for (; *name && *name != '.'; name++) {
+                if (i == 8)
+                        return -EINVARG;
+                out[i++] = tolower(*name);
         }
-        
-        /* Read each entry in the directory 
-         * TODO: if all the entries have been read from the cluster, we should see if there is another cluster following this one in the cluster chain or if this is the last cluster in the chain 
-         * Given we're currently not implementing the above, the max # of directory entries we can have in a directory is 2048.
-         * 128 sectors per cluster * 512 bytes per sector / 32 bytes per root directory entry = 2048 directory entries in a single cluster max
-         * Actually, the max we can have is 2047 directory entries so that we have a blank entry denoting the end of the directory
-         */
-        int count = 0;
-        while (1) {
-                if ((rc = disk_stream_read(directory_stream, &entry, sizeof(struct fat_directory_entry))) < 0) {
-                        return rc;
+
+        if (i == 0)
+                return -EINVARG;
+
+        if (*name == '.') {
+                name++;
+                int j = 0;
+                for (; *name; name++) {
+                        if (j == 3 || *name == '.')
+                                return -EINVARG;
+                        out[8 + j++] = tolower(*name);
+                }
+
+                if (j == 0)
+                        return -EINVARG;
+        }
+
+        return 0;
+}
+
+/* Writes the normalized 8.3 name of raw_entry (see fat16_normalize_name) to out */
+static void fat16_get_normalized_name(struct fat_directory_entry *raw_entry, char *out)
+{
+        for (int i = 0; i < 8; i++)
+                out[i] = tolower(raw_entry->filename[i]);
+        for (int i = 0; i < 3; i++)
+                out[8 + i] = raw_entry->ext[i] ? tolower(raw_entry->ext[i]) : ' ';
+}
+
+static uint32_t fat16_hash_name(const char *normalized_name)
+{
+        uint32_t hash = 0;
+        for (int i = 0; i < FAT_83_NAME_LEN; i++)
+                hash = hash * 31 + (unsigned char)normalized_name[i];
+
+        return hash;
+}
+
+/* Hashes a long file name ignoring case, since long names are compared ignoring case */
+static uint32_t fat16_hash_long_name(const char *name)
+{
+        uint32_t hash = 0;
+        for (; *name; name++)
+                hash = hash * 31 + (unsigned char)tolower(*name);
+
+        return hash;
+}
+
+/* Returns the checksum of raw_entry's 8.3 name that its long file name entries must hold */
+static uint8_t fat16_short_name_checksum(struct fat_directory_entry *raw_entry)
+{
+        uint8_t checksum = 0;
+        for (int i = 0; i < FAT_83_NAME_LEN; i++) {
+                uint8_t c = i < 8 ? raw_entry->filename[i] : raw_entry->ext[i - 8];
+                checksum = ((checksum & 1) << 7) + (checksum >> 1) + c;
+        }
+
+        return checksum;
+}
+
+static bool fat16_is_long_name_entry(struct fat_directory_entry *raw_entry)
+{
+        return raw_entry->filename[0] != FAT_DELETED_ENTRY && (raw_entry->attribute & 0x3F) == FAT_LFN_ATTRIBUTE;
+}
+
+/* Feeds the next entry of a directory, read in order, to decoder.
+ * Long file name entries are collected.  Any other entry, or an entry out of sequence, throws away what was collected.
+ */
+static void fat16_long_name_decode(struct fat_long_name_decoder *decoder, struct fat_directory_entry *raw_entry)
+{
+        if (!fat16_is_long_name_entry(raw_entry)) {
+                decoder->entries = 0;
+                return;
+        }
+
+        struct fat_long_name_entry *lfn = (struct fat_long_name_entry *)raw_entry;
+        int ordinal = lfn->ordinal & FAT_LFN_ORDINAL_MASK;
+        if (lfn->ordinal & FAT_LFN_LAST_ENTRY) {
+                if (ordinal == 0 || ordinal > FAT_LFN_MAX_ENTRIES) {
+                        decoder->entries = 0;
+                        return;
                 }
+                decoder->entries = ordinal;
+                decoder->checksum = lfn->checksum;
+                memset(decoder->chars, 0, sizeof(decoder->chars));
+        } else if (decoder->entries == 0 || ordinal != decoder->next || lfn->checksum != decoder->checksum) {
+                decoder->entries = 0;
+                return;
+        }
+
+        uint16_t *chars = &decoder->chars[(ordinal - 1) * FAT_LFN_CHARS_PER_ENTRY];
+        memcpy(chars, lfn->name1, sizeof(lfn->name1));
+        memcpy(chars + 5, lfn->name2, sizeof(lfn->name2));
+        memcpy(chars + 11, lfn->name3, sizeof(lfn->name3));
+        decoder->next = ordinal - 1;
+}
+
+/* Ends decoding at raw_entry, the 8.3 entry that follows the long file name entries fed to decoder.
+ * Returns the # of long file name entries in front of raw_entry if decoder holds its whole long name, or 0 if raw_entry has no long name
+ */
+static int fat16_long_name_complete(struct fat_long_name_decoder *decoder, struct fat_directory_entry *raw_entry)
+{
+        int entries = decoder->entries;
+        decoder->entries = 0;
+        if (entries == 0 || decoder->next != 0 || decoder->checksum != fat16_short_name_checksum(raw_entry))
+                return 0;
+
+        return entries;
+}
 
-                /* If the first byte of the entry is 0, then there are no more entries in this directory */
-                if (entry.filename[0] == 0x00)
+/* Writes the long file name held by decoder, which is made of entries long file name entries, to out as null terminated UTF-8.
+ * out must have room for FAT_LFN_UTF8_SIZE(entries) bytes.
+ * Returns the length of the name
+ */
+static int fat16_long_name_to_utf8(struct fat_long_name_decoder *decoder, int entries, char *out)
+{
+        char *start = out;
+        for (int i = 0; i < entries * FAT_LFN_CHARS_PER_ENTRY; i++) {
+                uint16_t c = decoder->chars[i];
+                if (c == 0x0000 || c == 0xFFFF)
                         break;
 
-                /* If the first byte of the entry is 0xE5, then the entry is unused (free) */
-                if (entry.filename[0] == 0xE5)
-                        continue;
+                if (c < 0x80) {
+                        *out++ = c;
+                } else if (c < 0x800) {
+                        *out++ = 0xC0 | (c >> 6);
+                        *out++ = 0x80 | (c & 0x3F);
+                } else {
+                        *out++ = 0xE0 | (c >> 12);
+                        *out++ = 0x80 | ((c >> 6) & 0x3F);
+                        *out++ = 0x80 | (c & 0x3F);
+                }
+        }
+
+        *out = 0;
+        return out - start;
+}
 
-                count++;
+/* If decoder holds the whole long file name of raw_entry (the 8.3 entry that follows it), appends it to directory->long_names as UTF-8.
+ * Returns the offset of the name in long_names + 1, 0 if raw_entry has no long name, or < 0 on failure
+ */
+static int fat16_long_name_finish(struct fat_directory *directory, struct fat_long_name_decoder *decoder, struct fat_directory_entry *raw_entry)
+{
+        int entries = fat16_long_name_complete(decoder, raw_entry);
+        if (entries == 0)
+                return 0;
+
+        int max_size = FAT_LFN_UTF8_SIZE(entries);
+        if (directory->long_names_size + max_size > directory->long_names_capacity) {
+                int capacity = directory->long_names_capacity ? directory->long_names_capacity : HEAP_BLOCK_SIZE;
+                while (directory->long_names_size + max_size > capacity)
+                        capacity *= 2;
+
+                char *long_names = kzalloc(capacity);
+                if (!long_names)
+                        return -ENOMEM;
+                if (directory->long_names) {
+                        memcpy(long_names, directory->long_names, directory->long_names_size);
+                        kfree(directory->long_names);
+                }
+                directory->long_names = long_names;
+                directory->long_names_capacity = capacity;
         }
 
-        return count;
+        int offset = directory->long_names_size;
+        int length = fat16_long_name_to_utf8(decoder, entries, directory->long_names + offset);
+        if (length == 0)
+                return 0;
+
+        directory->long_names_size = offset + length + 1;
+        return offset + 1;
+}
+
+/* Returns true if raw_entry is a file or directory that can be found by name.
+ * Free entries, the end of directory marker and volume labels (which long file name entries also look like) can't be.
+ */
+static bool fat16_is_named_entry(struct fat_directory_entry *raw_entry)
+{
+        if (raw_entry->filename[0] == 0x00 || raw_entry->filename[0] == 0xE5)
+                return false;
+
+        return !(raw_entry->attribute & FAT_FILE_VOLUME_LABEL);
 }
 
 /* 
- * Load the root directory into the fat_directory structure out_root_dir
+ * Fill in the location of the root directory in out_root_dir.  Its entries are indexed separately (fat16_build_directory_index).
  * Returns 0 on success or < 0 on failure
  */
 static int fat16_get_root_directory(struct disk *disk, struct fat_private *fat_private, struct fat_directory *out_root_dir)
 {
-        int rc;
-
         struct fat_header_primary *primary_header = &fat_private->header.fat_header_primary;
-        int root_dir_sector = primary_header->fat_copies * primary_header->sectors_per_fat + primary_header->reserved_sectors;
-        int root_dir_size = primary_header->root_dir_entries * sizeof(struct fat_directory_entry);      //It looks like I'm assuming that 
+        int root_dir_sector = primary_header->fat_copies * fat_private->sectors_per_fat + primary_header->reserved_sectors;
+        int root_dir_size = primary_header->root_dir_entries * sizeof(struct fat_directory_entry);
         int root_dir_total_sectors = root_dir_size / disk->sector_size;
         if (root_dir_size % disk->sector_size != 0) {
                 root_dir_total_sectors++;
         }
 
-        /* Since we are not setting root_dir_entries in the primary header (via our boot.asm file), we need to dynamically resolve this value */
-        int root_dir_total_items = fat16_get_total_items_for_directory(disk, root_dir_sector);
+        /* A FAT32 root directory is a cluster chain in the data region, so the data region starts right after the FATs */
+        if ((root_dir_total_sectors == 0) != (fat_private->type == FAT_TYPE_32))
+                return -EFSNOTUS;
+
+        out_root_dir->sector = root_dir_sector;
+        out_root_dir->end_sector = root_dir_sector + root_dir_total_sectors;
+        out_root_dir->cluster = 0;
+
+        return 0;
+}
+
+/* Fills in fat_private->layout from the header.  The root directory must already be located, since the data region starts after it.
+ * Returns 0 on success or -EFSNOTUS if the cluster size isn't a power of two
+ */
+static int fat16_init_layout(struct disk *disk, struct fat_private *fat_private)
+{
+        struct fat_layout *layout = &fat_private->layout;
+        int sectors_per_cluster = fat_private->header.fat_header_primary.sectors_per_cluster;
+        if (sectors_per_cluster == 0 || (sectors_per_cluster & (sectors_per_cluster - 1)))
+                return -EFSNOTUS;
+
+        layout->cluster_shift = 0;
+        while ((1 << layout->cluster_shift) < sectors_per_cluster)
+                layout->cluster_shift++;
+        layout->cluster_bytes_shift = layout->cluster_shift + disk->sector_shift;
+        layout->cluster_size = 1 << layout->cluster_bytes_shift;
+        layout->cluster_mask = layout->cluster_size - 1;
+
+        /* The first FAT comes directly after the reserved region (which contains our boot and kernel code) */
+        layout->fat_lba = fat_private->header.fat_header_primary.reserved_sectors;
+        layout->data_lba = fat_private->root_directory.end_sector;
+        return 0;
+}
+
+/* Returns the sector that the first FAT (file allocation table) starts at */
+static uint32_t fat16_get_first_fat_sector(struct fat_private *fat_private)
+{
+        return fat_private->layout.fat_lba;
+}
+
+/* Reads the FAT in use (the first one, unless a FAT32 volume says otherwise) into fat_private->fat_table using stream.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_load_fat_table(struct disk *disk, struct fat_private *fat_private, struct disk_stream *stream)
+{
+        int rc = 0;
+        int fat_size = fat_private->sectors_per_fat * disk->sector_size;
+        if (fat_size <= 0)
+                return -EFSNOTUS;
+
+        fat_private->fat_first_copy = 0;
+        fat_private->fat_mirrors = fat_private->header.fat_header_primary.fat_copies;
+        if (fat_private->type == FAT_TYPE_32 && (fat_private->header.fat32_header.flags & FAT32_MIRRORING_DISABLED)) {
+                fat_private->fat_first_copy = fat_private->header.fat32_header.flags & 0x0F;
+                fat_private->fat_mirrors = 1;
+                if (fat_private->fat_first_copy >= fat_private->header.fat_header_primary.fat_copies)
+                        return -EFSNOTUS;
+        }
 
-        struct fat_directory_entry *root_dir = kzalloc(root_dir_size);
-        if (!root_dir)
+        fat_private->fat_table = kzalloc(fat_size);
+        if (!fat_private->fat_table)
                 return -ENOMEM;
 
-        struct disk_stream *stream = fat_private->directory_stream;
-        if ((rc = disk_stream_seek(stream, fat16_sector_to_absolute_pos(disk, root_dir_sector))) < 0)
+        uint64_t fat_sector = fat16_get_first_fat_sector(fat_private) + (uint64_t)fat_private->fat_first_copy * fat_private->sectors_per_fat;
+        if ((rc = disk_stream_seek(stream, fat16_sector_to_absolute_pos(disk, fat_sector))) < 0)
                 return rc;
 
-        if ((rc = disk_stream_read(stream, root_dir, root_dir_size)) < 0)
+        if ((rc = disk_stream_read(stream, fat_private->fat_table, fat_size)) < 0)
                 return rc;
 
-        out_root_dir->entry = root_dir;
-        out_root_dir->total = root_dir_total_items;
-        out_root_dir->sector = root_dir_sector;
-        out_root_dir->end_sector = root_dir_sector + root_dir_size / disk->sector_size;
+        fat_private->fat_entry_size = fat_private->type == FAT_TYPE_32 ? FAT32_FAT_ENTRY_SIZE : FAT16_FAT_ENTRY_SIZE;
+        fat_private->fat_table_entries = fat_size / fat_private->fat_entry_size;
+        return 0;
+}
+
+/* Returns entry cluster of the in-memory FAT, without the reserved bits of a FAT32 entry */
+static uint32_t fat16_fat_table_get(struct fat_private *fat_private, int cluster)
+{
+        if (fat_private->type == FAT_TYPE_32)
+                return ((uint32_t *)fat_private->fat_table)[cluster] & FAT32_ENTRY_MASK;
+
+        return ((uint16_t *)fat_private->fat_table)[cluster];
+}
+
+/* Sets entry cluster of the in-memory FAT to value (truncated to the entry width), preserving the reserved bits of a FAT32 entry */
+static void fat16_fat_table_set(struct fat_private *fat_private, int cluster, uint32_t value)
+{
+        if (fat_private->type == FAT_TYPE_32) {
+                uint32_t *entry = &((uint32_t *)fat_private->fat_table)[cluster];
+                *entry = (*entry & ~FAT32_ENTRY_MASK) | (value & FAT32_ENTRY_MASK);
+        } else {
+                ((uint16_t *)fat_private->fat_table)[cluster] = value;
+        }
+}
+
+/* Reads the FSInfo sector of a FAT32 volume.  A volume without a valid one just goes without its hints.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_load_fsinfo(struct disk *disk, struct fat_private *fat_private, struct disk_stream *stream)
+{
+        uint32_t sector = fat_private->header.fat32_header.fsinfo_sector;
+        if (sector == 0 || sector >= fat_private->header.fat_header_primary.reserved_sectors)
+                return 0;
+
+        int rc = 0;
+        if ((rc = disk_stream_seek(stream, fat16_sector_to_absolute_pos(disk, sector))) < 0 ||
+            (rc = disk_stream_read(stream, &fat_private->fsinfo, sizeof(struct fat32_fsinfo))) < 0)
+                return rc;
+
+        if (fat_private->fsinfo.lead_signature == FAT32_FSINFO_LEAD_SIGNATURE &&
+            fat_private->fsinfo.struct_signature == FAT32_FSINFO_STRUCT_SIGNATURE)
+                fat_private->fsinfo_sector = sector;
 
         return 0;
-        
 }
 
-/* fat16_resolve
-*
-* Reads boot sector of disk and returns 0 if disk is formatted to FAT16 or < 0 otherwise
-*/
-int fat16_resolve(struct disk *disk)
+/* Builds the free-cluster bitmap from the in-memory FAT, and allocates the other buffers that writes need.
+ * The layout must already be worked out.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_init_allocator(struct disk *disk, struct fat_private *fat_private)
+{
+        struct fat_header_primary *primary_header = &fat_private->header.fat_header_primary;
+        uint32_t total_sectors = primary_header->number_of_sectors ? primary_header->number_of_sectors : primary_header->sectors_big;
+        if (total_sectors == 0 || total_sectors > disk->total_sectors)
+                total_sectors = disk->total_sectors;
+
+        int total_clusters = 2;
+        if (total_sectors > fat_private->layout.data_lba)
+                total_clusters += (total_sectors - fat_private->layout.data_lba) >> fat_private->layout.cluster_shift;
+        if (total_clusters > fat_private->fat_table_entries)
+                total_clusters = fat_private->fat_table_entries;
+        fat_private->total_clusters = total_clusters;
+
+        fat_private->fat_dirty = kzalloc(fat_private->sectors_per_fat);
+        fat_private->free_bitmap = kzalloc(((total_clusters + 31) >> 5) * sizeof(uint32_t));
+        fat_private->sector_buffer = kzalloc(disk->sector_size);
+        if (!fat_private->fat_dirty || !fat_private->free_bitmap || !fat_private->sector_buffer)
+                return -ENOMEM;
+
+        for (int cluster = 2; cluster < total_clusters; cluster++) {
+                if (fat16_fat_table_get(fat_private, cluster) == FAT16_UNUSED) {
+                        fat_private->free_bitmap[cluster >> 5] |= 1u << (cluster & 31);
+                        fat_private->free_clusters++;
+                }
+        }
+
+        /* FSInfo remembers where the last driver found free clusters.  The free count is recounted above, since the bitmap needs the walk anyway. */
+        fat_private->alloc_rover = 2;
+        uint32_t next_free = fat_private->fsinfo.next_free;
+        if (fat_private->fsinfo_sector && next_free >= 2 && next_free < (uint32_t)total_clusters)
+                fat_private->alloc_rover = next_free;
+
+        return 0;
+}
+
+/* Reads boot sector of disk and returns 0 if disk is formatted to the FAT variant type or < 0 otherwise.
+ * A FAT32 volume is told apart by its FAT16 sectors_per_fat field, which is 0.
+ */
+static int fat_resolve(struct disk *disk, enum fat_type type)
 {
         int rc = 0;
 
         struct fat_private *fat_private = kzalloc(sizeof(struct fat_private));
+        if (!fat_private)
+                return -ENOMEM;
+
         fat16_init_private(disk, fat_private);
 
         disk->fs_private = fat_private;
 
         struct disk_stream *stream = get_disk_stream(disk->id);
-        if (!stream) {
+        if (!stream || !fat_private->cluster_read_stream || !fat_private->directory_stream) {
                 rc = -ENOMEM;
                 goto out;
         }    
         
         if ((rc = disk_stream_read(stream, &fat_private->header, sizeof(fat_private->header))) < 0)
                 goto out;
-        
-        if (fat_private->header.fat_header_extended.extended_boot_signature != 0x29) {
+
+        struct fat_header *header = &fat_private->header;
+        fat_private->type = header->fat_header_primary.sectors_per_fat ? FAT_TYPE_16 : FAT_TYPE_32;
+        if (fat_private->type != type) {
                 rc = -EFSNOTUS;
                 goto out;
         }
+
+        if (type == FAT_TYPE_16) {
+                if (header->fat_header_extended.extended_boot_signature != FAT16_SIGNATURE) {
+                        rc = -EFSNOTUS;
+                        goto out;
+                }
+                fat_private->sectors_per_fat = header->fat_header_primary.sectors_per_fat;
+        } else {
+                if (header->fat32_header_extended.extended_boot_signature != FAT16_SIGNATURE || header->fat32_header.root_cluster < 2) {
+                        rc = -EFSNOTUS;
+                        goto out;
+                }
+                fat_private->sectors_per_fat = header->fat32_header.sectors_per_fat;
+                fat_private->root_cluster = header->fat32_header.root_cluster;
+                if ((rc = fat16_load_fsinfo(disk, fat_private, stream)) < 0)
+                        goto out;
+        }
                 
         if ((rc = fat16_get_root_directory(disk, fat_private, &fat_private->root_directory)) < 0)
                 goto out;
 
-        disk->filesystem = &fat16_fs;
+        if ((rc = fat16_init_layout(disk, fat_private)) < 0)
+                goto out;
+
+        if ((rc = fat16_load_fat_table(disk, fat_private, stream)) < 0)
+                goto out;
+
+        if ((rc = fat16_init_allocator(disk, fat_private)) < 0)
+                goto out;
+
+        if (fat_private->root_cluster >= (uint32_t)fat_private->total_clusters) {
+                rc = -EFSNOTUS;
+                goto out;
+        }
+
+        /* Directory entries are read a few at a time, so buffer whole clusters of the data region */
+        int sectors_per_cluster = 1 << fat_private->layout.cluster_shift;
+        disk_stream_set_fill(fat_private->directory_stream, fat_private->layout.data_lba, sectors_per_cluster);
+        disk_stream_set_fill(fat_private->cluster_read_stream, fat_private->layout.data_lba, sectors_per_cluster);
+
+        if ((rc = fat16_build_directory_index(disk, &fat_private->root_directory)) < 0)
+                goto out;
+
+        /* Lookups cached for a filesystem that was previously on this disk are stale */
+        dcache_invalidate_disk(disk);
+        disk->filesystem = type == FAT_TYPE_32 ? &fat32_fs : &fat16_fs;
         
 out:
         if (stream)
                 disk_stream_close(stream);
 
         if (rc < 0) {
-                kfree(fat_private);
+                fat16_free_private(fat_private);
                 disk->fs_private = 0;
         }
 
         return rc;
 }
 
-/*
- * Filenames in FAT16 must be trailing padded with space bytes (ASCII: 0x20).  This function accepts a 
- * string at in and returns a new string at out that has null chars in the place of spaces
- * 
- * Returns 0 on success or < 0 on failure
- * 
- * Side effect: increments the char pointer that out points to
- * TODO: seems like this function would be more versatile if it didn't have the above side effect.  Would have to rework how it's used in get filename if this was the case
- */
-static int fat16_convert_spaces_to_null(char **out, const char *in)
+/* fat16_resolve
+*
+* Reads boot sector of disk and returns 0 if disk is formatted to FAT16 or < 0 otherwise
+*/
+int fat16_resolve(struct disk *disk)
 {
-        // CHECK: he uses a pointer to a pointer for out.  Do I need to do that as well?
-        while (*in != 0x00 && *in != 0x20) {
-                **out = *in;
-                *out += 1;
-                in += 1;
-        }
-
-        if (*in == 0x20)
-                **out = 0x00;
+        return fat_resolve(disk, FAT_TYPE_16);
+}
 
-        return 0;
+/* fat32_resolve
+*
+* Reads boot sector of disk and returns 0 if disk is formatted to FAT32 or < 0 otherwise
+*/
+int fat32_resolve(struct disk *disk)
+{
+        return fat_resolve(disk, FAT_TYPE_32);
 }
 
-/* Writes the filename associated with raw_entry to the buffer at out.  
- * At max will write maxlen chars (bytes) to out.
- * Returns 0 on success or < 0 on failure
+/* Writes the filename associated with raw_entry to the buffer at out: 'NAME.EXT', or 'NAME' if it has no extension.
+ * Filenames in FAT16 must be trailing padded with space bytes (ASCII: 0x20), which are left out.
+ * At max will write maxlen chars (bytes) to out, including the null terminator.
+ * Returns 0 on success or -EINVARG if maxlen is too small for an 8.3 name
  */
 static int fat16_get_filename(struct fat_directory_entry *raw_entry, char *out, int maxlen)
 {
-        memset(out, 0x00, maxlen);
-        fat16_convert_spaces_to_null(&out, (const char *)raw_entry->filename);
+        if (maxlen < FAT_83_NAME_LEN + 2)
+                return -EINVARG;
+
+        int n = 0;
+        for (int i = 0; i < 8 && raw_entry->filename[i] != 0x00 && raw_entry->filename[i] != 0x20; i++)
+                out[n++] = raw_entry->filename[i];
 
         /* Check to see if the file has an extension */
         if (raw_entry->ext[0] != 0x00 && raw_entry->ext[0] != 0x20) {
-                *out = '.';
-                out++;
-                fat16_convert_spaces_to_null(&out, (const char *)raw_entry->ext);
+                out[n++] = '.';
+                for (int i = 0; i < 3 && raw_entry->ext[i] != 0x00 && raw_entry->ext[i] != 0x20; i++)
+                        out[n++] = raw_entry->ext[i];
         }
 
+        out[n] = 0x00;
         return 0;
 }
 
@@ -356,280 +980,1305 @@ static struct fat_directory_entry *fat16_clone_raw_dir_entry(struct fat_director
 }
 
 /* Returns the index # (CHS indexing starts at 1) of the sector that corresponds with the start of cluster */
-static int fat16_cluster_to_start_sector(struct fat_private *fat_private, int cluster)
+static uint32_t fat16_cluster_to_start_sector(struct fat_private *fat_private, uint32_t cluster)
 {
         /* To understand this function, remember that the data region starts after the root directory and
          * is composed of cluster, each of which are made of multiple sectors.
-         * The first two FAT entries (which theoretically correspond to clusters 0 and 1) store special data, which is why we multiply (cluster - 2) with the sectors per cluster.  Thus, the data region
+         * The first two FAT entries (which theoretically correspond to clusters 0 and 1) store special data, which is why we shift (cluster - 2) by the cluster size.  Thus, the data region
          * starts at cluster 2.  
          */
-        return fat_private->root_directory.end_sector + (cluster - 2) * fat_private->header.fat_header_primary.sectors_per_cluster;
+        return fat_private->layout.data_lba + ((cluster - 2) << fat_private->layout.cluster_shift);
 }
 
-/* Returns the index of the initial cluster that contains raw_entry's data 
+/* Returns the absolute position on disk of offset bytes into cluster (offset may run past the end of cluster into the clusters after it) */
+static uint64_t fat16_cluster_to_absolute_pos(struct disk *disk, uint32_t cluster, uint32_t offset)
+{
+        return fat16_sector_to_absolute_pos(disk, fat16_cluster_to_start_sector(disk->fs_private, cluster)) + offset;
+}
+
+/* Returns the index of the initial cluster that contains raw_entry's data 
  * If raw_entry represents a directory, then the first cluster will contain directory entries (directory cluster).
  * If raw_entry represents a file, then the first cluster will contain file data (data cluster).
  */
 static uint32_t fat16_get_first_cluster(struct fat_directory_entry *raw_entry)
 {
-        return raw_entry->low_16_bits_first_cluster | raw_entry->high_16_bits_first_cluster;
+        return (uint32_t)raw_entry->high_16_bits_first_cluster << 16 | raw_entry->low_16_bits_first_cluster;
 }
 
-/* Returns the sector that the first FAT (file allocation table) starts at */
-static uint32_t fat16_get_first_fat_sector(struct fat_private *fat_private)
+/* Makes cluster the first cluster of raw_entry's data */
+static void fat16_set_first_cluster(struct fat_directory_entry *raw_entry, uint32_t cluster)
 {
-        /* The first FAT comes directly after the reserved region (which contains our boot and kernel code) */
-        return fat_private->header.fat_header_primary.reserved_sectors;
+        raw_entry->low_16_bits_first_cluster = cluster & 0xFFFF;
+        raw_entry->high_16_bits_first_cluster = cluster >> 16;
 }
 
 /* Returns the file allocation table (fat) entry that corresponds with cluster 
  * Returns < 0 on error
  */
-static uint16_t fat16_get_fat_entry(struct disk *disk, int cluster)
+static int fat16_get_fat_entry(struct disk *disk, int cluster)
 {
-        /* Each fat entry is 16 bits, or two bytes */
-        int rc = 0;
         struct fat_private *fat_private = disk->fs_private;
-        struct disk_stream *fat_read_stream = fat_private->fat_read_stream;
-
-        uint32_t fat_table_position_bytes = fat16_get_first_fat_sector(fat_private) * disk->sector_size;
-        if ((rc = disk_stream_seek(fat_read_stream, fat_table_position_bytes + cluster * FAT16_FAT_ENTRY_SIZE)) < 0)
-                return rc;
+        if (cluster < 0 || cluster >= fat_private->fat_table_entries)
+                return -EIO;
 
-        uint16_t entry = 0;
-        entry = disk_stream_read(fat_read_stream, &entry, FAT16_FAT_ENTRY_SIZE);
+        return fat16_fat_table_get(fat_private, cluster);
+}
 
-        return entry;
+/* Returns true if entry (a FAT entry) links to another cluster, rather than marking the end of a chain, a bad cluster, etc.
+ * Every such marker is past the last cluster of the volume, whatever the FAT's width.
+ */
+static bool fat16_is_next_cluster(struct fat_private *fat_private, int entry)
+{
+        return entry >= 2 && entry < fat_private->total_clusters;
 }
 
-/* Returns the cluster in the chain that is offset bytes from the beginning of the cluster chain_start_cluster */
-static int fat16_get_cluster_in_chain(struct disk *disk, int chain_start_cluster, int offset)
+/* Builds the extent list of the cluster chain that starts at first_cluster.
+ * On success, *out is set to a new array of *total extents (0 and 0 for an empty chain).
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_build_extents(struct disk *disk, int first_cluster, struct fat_extent **out, int *total)
 {
         struct fat_private *fat_private = disk->fs_private;
-        int cluster = chain_start_cluster;
-        int cluster_size_bytes = fat_private->header.fat_header_primary.sectors_per_cluster * disk->sector_size;
-        int clusters_ahead = offset / cluster_size_bytes;
-        for (int i = 0; i < clusters_ahead; i++) {
-                int entry = fat16_get_fat_entry(disk, cluster);
-                if (entry >= 0xFFF8 && entry <= 0xFFFF) {
-                        /* 0xFFF8 - 0xFFFF represent End-of-file 
-                         * If we've entered this if statement, then it means that the offset provided is out of bounds with regards to the cluster chain at chain_start_cluster
-                         */
+        *out = 0;
+        *total = 0;
+        if (!fat16_is_next_cluster(fat_private, first_cluster))
+                return 0;
+
+        /* Count the runs first so the list can be allocated at once.  A chain can't be longer than the FAT, which bounds the walk if it loops. */
+        int runs = 1;
+        int length = 1;
+        int cluster = first_cluster;
+        int entry;
+        while (fat16_is_next_cluster(fat_private, entry = fat16_get_fat_entry(disk, cluster))) {
+                if (++length > fat_private->fat_table_entries)
                         return -EIO;
+                if (entry != cluster + 1)
+                        runs++;
+                cluster = entry;
+        }
+
+        struct fat_extent *extents = kzalloc(runs * sizeof(struct fat_extent));
+        if (!extents)
+                return -ENOMEM;
+
+        int i = 0;
+        extents[0].cluster = first_cluster;
+        extents[0].count = 1;
+        cluster = first_cluster;
+        for (int file_cluster = 1; file_cluster < length; file_cluster++) {
+                entry = fat16_get_fat_entry(disk, cluster);
+                if (entry == cluster + 1) {
+                        extents[i].count++;
+                } else {
+                        i++;
+                        extents[i].file_cluster = file_cluster;
+                        extents[i].cluster = entry;
+                        extents[i].count = 1;
                 }
+                cluster = entry;
+        }
 
-                if (entry == FAT16_BAD_SECTOR)
-                        return -EIO;
-                
-                /* Reserved entry (first and second fat entries are reserved to hold special data) */
-                if (entry >= 0xFFF0 && entry <= 0xFFF6)
-                        return -EIO;
+        *out = extents;
+        *total = runs;
+        return 0;
+}
 
-                /* If the entry is 0, then there is not an associated cluster */
-                if (entry == 0x0000)
+/* Returns the extent of file that holds the file's file_cluster'th cluster, or 0 if the file is shorter than that */
+static struct fat_extent *fat16_find_extent(struct fat_file *file, uint32_t file_cluster)
+{
+        int low = 0;
+        int high = file->total_extents - 1;
+        while (low <= high) {
+                int mid = (low + high) / 2;
+                struct fat_extent *extent = &file->extents[mid];
+                if (file_cluster < extent->file_cluster)
+                        high = mid - 1;
+                else if (file_cluster >= extent->file_cluster + extent->count)
+                        low = mid + 1;
+                else
+                        return extent;
+        }
+
+        return 0;
+}
+
+/* Reads file, starting offset bytes into the file, into the iovcnt segments of iov, in order.
+ * The pieces of the segments that fall in one extent are filled with a single vectored stream read.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_read_filev(struct disk *disk, struct fat_file *file, uint32_t offset, struct disk_stream_iovec *iov, int iovcnt)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        struct disk_stream *cluster_read_stream = fat_private->cluster_read_stream;
+        int cluster_bytes_shift = fat_private->layout.cluster_bytes_shift;
+
+        struct disk_stream_iovec pieces[DISK_STREAM_IOV_MAX];
+        int i = 0;
+        int done = 0;   /* Bytes of iov[i] already read */
+        int rc = 0;
+        while (i < iovcnt) {
+                if (done == iov[i].len) {
+                        i++;
+                        done = 0;
+                        continue;
+                }
+
+                uint32_t file_cluster = offset >> cluster_bytes_shift;
+                struct fat_extent *extent = fat16_find_extent(file, file_cluster);
+                if (!extent)
                         return -EIO;
 
-                cluster = (int)entry;
+                int offset_in_extent = offset - (extent->file_cluster << cluster_bytes_shift);
+                int extent_left = (extent->count << cluster_bytes_shift) - offset_in_extent;
+
+                /* Gather the segments, or parts of them, that lie in the rest of this extent */
+                int npieces = 0;
+                int bytes_to_read = 0;
+                while (i < iovcnt && npieces < DISK_STREAM_IOV_MAX && bytes_to_read < extent_left) {
+                        int bytes = iov[i].len - done;
+                        if (bytes > extent_left - bytes_to_read)
+                                bytes = extent_left - bytes_to_read;
+
+                        if (bytes > 0) {
+                                pieces[npieces].buf = (char *)iov[i].buf + done;
+                                pieces[npieces].len = bytes;
+                                npieces++;
+                                bytes_to_read += bytes;
+                                done += bytes;
+                        }
+                        if (done == iov[i].len) {
+                                i++;
+                                done = 0;
+                        }
+                }
+
+                uint64_t pos = fat16_cluster_to_absolute_pos(disk, extent->cluster, offset_in_extent);
+                if ((rc = disk_stream_seek(cluster_read_stream, pos)) < 0)
+                        return rc;
+                if ((rc = disk_stream_readv(cluster_read_stream, pieces, npieces)) < 0)
+                        return rc;
+
+                offset += bytes_to_read;
+        }
+
+        return 0;
+}
+
+/* Reads n bytes of file, starting offset bytes into the file, into out.  Returns 0 on success or < 0 on failure */
+static int fat16_read_file(struct disk *disk, struct fat_file *file, uint32_t offset, int n, char *out)
+{
+        struct disk_stream_iovec iov = { .buf = out, .len = n };
+        return fat16_read_filev(disk, file, offset, &iov, 1);
+}
+
+/* Sets the FAT entry of cluster to value in the in-memory FAT, keeping the free-cluster bitmap in step.
+ * The change reaches the disk with the next fat16_flush_fat.
+ */
+static void fat16_set_fat_entry(struct disk *disk, int cluster, uint32_t value)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        bool was_free = fat16_fat_table_get(fat_private, cluster) == FAT16_UNUSED;
+        fat16_fat_table_set(fat_private, cluster, value);
+        value = fat16_fat_table_get(fat_private, cluster);
+        fat_private->fat_dirty[(cluster * fat_private->fat_entry_size) >> disk->sector_shift] = 1;
+
+        uint32_t bit = 1u << (cluster & 31);
+        if (value == FAT16_UNUSED && !was_free) {
+                fat_private->free_bitmap[cluster >> 5] |= bit;
+                fat_private->free_clusters++;
+        } else if (value != FAT16_UNUSED && was_free) {
+                fat_private->free_bitmap[cluster >> 5] &= ~bit;
+                fat_private->free_clusters--;
+        }
+}
+
+/* Writes each run of changed FAT sectors to every copy of the FAT in use with one write per copy.
+ * On FAT32, the FSInfo free cluster count and next free cluster hints are brought up to date as well.
+ * The writes land in the buffer cache, so a FAT sector that changes in several operations in a row is only written to the drive once.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_flush_fat(struct disk *disk)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        int sectors_per_fat = fat_private->sectors_per_fat;
+        bool changed = false;
+        int rc = 0;
+
+        int sector = 0;
+        while (sector < sectors_per_fat) {
+                if (!fat_private->fat_dirty[sector]) {
+                        sector++;
+                        continue;
+                }
+
+                int run = 1;
+                while (sector + run < sectors_per_fat && fat_private->fat_dirty[sector + run])
+                        run++;
+
+                char *data = (char *)fat_private->fat_table + (sector << disk->sector_shift);
+                for (int copy = fat_private->fat_first_copy; copy < fat_private->fat_first_copy + fat_private->fat_mirrors; copy++) {
+                        uint64_t lba = fat16_get_first_fat_sector(fat_private) + (uint64_t)copy * sectors_per_fat + sector;
+                        if ((rc = disk_write_block(disk, lba, run, data)) < 0)
+                                return rc;
+                }
+
+                memset(fat_private->fat_dirty + sector, 0, run);
+                sector += run;
+                changed = true;
         }
+
+        if (!changed || !fat_private->fsinfo_sector)
+                return 0;
+
+        /* free_count and next_free are next to each other, so they're patched with one write */
+        fat_private->fsinfo.free_count = fat_private->free_clusters;
+        fat_private->fsinfo.next_free = fat_private->alloc_rover;
+        uint64_t pos = fat16_sector_to_absolute_pos(disk, fat_private->fsinfo_sector) + offsetof(struct fat32_fsinfo, free_count);
+        return fat16_write_bytes(disk, pos, 2 * sizeof(uint32_t), (const char *)&fat_private->fsinfo.free_count);
+}
+
+static bool fat16_is_free_cluster(struct fat_private *fat_private, int cluster)
+{
+        return fat_private->free_bitmap[cluster >> 5] & (1u << (cluster & 31));
+}
+
+/* Returns the first cluster in [cluster, end) whose free bit is free (true for a free cluster, false for a used one), or end if there isn't one.
+ * The free-cluster bitmap is scanned a word at a time.
+ */
+static int fat16_scan_clusters(struct fat_private *fat_private, int cluster, int end, bool free)
+{
+        uint32_t invert = free ? 0 : 0xFFFFFFFF;
+        while (cluster < end) {
+                uint32_t bits = (fat_private->free_bitmap[cluster >> 5] ^ invert) & (0xFFFFFFFF << (cluster & 31));
+                if (bits) {
+                        int found = (cluster & ~31) + __builtin_ctz(bits);
+                        return found < end ? found : end;
+                }
+
+                cluster = (cluster & ~31) + 32;
+        }
+
+        return end;
+}
+
+/* Looks for a run of want free clusters in [start, end).  Returns the first cluster of the first run that's long enough.
+ * Otherwise returns the first cluster of the longest run (or -ENOSPC if there is none) and lets the caller settle for it.
+ * *length is set to the length of the run, capped at want.
+ */
+static int fat16_find_free_run_in(struct fat_private *fat_private, int start, int end, int want, int *length)
+{
+        int best = -ENOSPC;
+        *length = 0;
+
+        int cluster = fat16_scan_clusters(fat_private, start, end, true);
+        while (cluster < end) {
+                int limit = end - cluster > want ? cluster + want : end;
+                int run = fat16_scan_clusters(fat_private, cluster, limit, false) - cluster;
+                if (run > *length) {
+                        best = cluster;
+                        *length = run;
+                        if (run == want)
+                                break;
+                }
+
+                /* cluster + run is used (or is end), so the next run starts at the next free cluster after it */
+                cluster = fat16_scan_clusters(fat_private, cluster + run, end, true);
+        }
+
+        return best;
+}
+
+/* Looks for a run of want free clusters starting at start, wrapping around to the start of the disk.
+ * Returns the first cluster of the run, or of the longest shorter run when none is long enough, or -ENOSPC if no clusters are free.
+ * *length is set to the length of the run, capped at want.
+ */
+static int fat16_find_free_run(struct fat_private *fat_private, int start, int want, int *length)
+{
+        int wrapped_length = 0;
+        int cluster = fat16_find_free_run_in(fat_private, start, fat_private->total_clusters, want, length);
+        if (*length == want)
+                return cluster;
+
+        int wrapped = fat16_find_free_run_in(fat_private, 2, start, want, &wrapped_length);
+        if (wrapped_length > *length) {
+                *length = wrapped_length;
+                return wrapped;
+        }
+
+        return cluster;
+}
+
+/* Allocates a run of up to want free, contiguous clusters and chains them together, the last one marked as the end of a chain.
+ * preferred (e.g. the cluster after the end of a growing file) is used if it's free, and the run is as much of want as is free after it.
+ * Otherwise the run is the first one of want clusters from the rover (or the longest one there is).  The rover then moves
+ * reserve clusters past the run, so that the next file placed in a new spot doesn't take the room this one will grow into.
+ * Sets *count to the # of clusters in the run.  Returns the run's first cluster, or -ENOSPC if the disk is full
+ */
+static int fat16_alloc_run(struct disk *disk, int preferred, int want, int reserve, int *count)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        if (fat_private->free_clusters == 0)
+                return -ENOSPC;
+
+        int cluster = 0;
+        if (preferred >= 2 && preferred < fat_private->total_clusters && fat16_is_free_cluster(fat_private, preferred)) {
+                int limit = fat_private->total_clusters - preferred > want ? preferred + want : fat_private->total_clusters;
+                cluster = preferred;
+                *count = fat16_scan_clusters(fat_private, preferred, limit, false) - preferred;
+        } else {
+                cluster = fat16_find_free_run(fat_private, fat_private->alloc_rover, want, count);
+                if (cluster < 0)
+                        return cluster;
+
+                int rover = cluster + *count + reserve;
+                fat_private->alloc_rover = rover < fat_private->total_clusters ? rover : 2;
+        }
+
+        for (int i = 0; i < *count - 1; i++)
+                fat16_set_fat_entry(disk, cluster + i, cluster + i + 1);
+        fat16_set_fat_entry(disk, cluster + *count - 1, FAT_END_OF_CHAIN);
         return cluster;
 }
 
-/* Reads n bytes from the cluster chain beginning at chain_start_cluster.
- * Starts at offset bytes from chain_start_cluster.  If offset is large enough, this may mean that the read will start in a cluster further along the chain than chain_start_cluster.
- * Stores the read data at out.
+/* Allocates a free cluster and marks it as the end of a chain.
+ * preferred is taken if it's free so that chains stay contiguous (see fat16_alloc_run).
+ * Returns the cluster, or -ENOSPC if the disk is full
+ */
+static int fat16_alloc_cluster(struct disk *disk, int preferred)
+{
+        int count = 0;
+        return fat16_alloc_run(disk, preferred, 1, FAT_ALLOC_RESERVE_CLUSTERS, &count);
+}
+
+/* Frees every cluster in the chain that starts at cluster.  Returns 0 on success or < 0 on failure */
+static int fat16_free_chain(struct disk *disk, int cluster)
+{
+        struct fat_private *fat_private = disk->fs_private;
+
+        /* Freed clusters read as 0, so a chain that loops back on itself ends the walk */
+        while (fat16_is_next_cluster(fat_private, cluster)) {
+                int next = fat16_get_fat_entry(disk, cluster);
+                if (next < 0)
+                        return next;
+
+                fat16_set_fat_entry(disk, cluster, FAT16_UNUSED);
+                cluster = next;
+        }
+
+        return 0;
+}
+
+/* Writes n bytes from in (or zeros if in is 0) to the disk, starting at the absolute position pos.
+ * Whole sectors are written straight from in.  Partial sectors are read, patched and written back.
+ * The writes land in the buffer cache.
  * Returns 0 on success or < 0 on failure
  */
-static int fat16_read_internal(struct disk *disk, int chain_start_cluster, int offset, int n, void *out)
+static int fat16_write_bytes(struct disk *disk, uint64_t pos, uint32_t n, const char *in)
 {
         struct fat_private *fat_private = disk->fs_private;
-        struct disk_stream *cluster_read_stream = fat_private->cluster_read_stream;
-        int cluster_size_bytes = fat_private->header.fat_header_primary.sectors_per_cluster * disk->sector_size;
-        int start_cluster = fat16_get_cluster_in_chain(disk, chain_start_cluster, offset);
-        if (start_cluster < 0)
-                return start_cluster;
-
-        int offset_from_cluster = offset % cluster_size_bytes;
-        int start_sector = fat16_cluster_to_start_sector(fat_private, start_cluster);
-        int start_pos_bytes = start_sector * disk->sector_size + offset_from_cluster;
-        /* We can only read up to the end of a cluster.  Then we have to find the next cluster in the chain
-         *
-         * TODO: This has the same error that Daniel made elsewhere in the stream code.  If offset is partially into the cluster already,
-         * then n does not necessarily have to be larger than cluster_size_bytes for the read to overrun into the next cluster.
-         * This code incorrectly assumes that we're starting a read from the beginning of a cluster.
-         */
-        int bytes_to_read = n > cluster_size_bytes ? cluster_size_bytes : n;
+        char *sector_buffer = fat_private->sector_buffer;
+        int rc = 0;
+
+        while (n > 0) {
+                uint64_t lba = pos >> disk->sector_shift;
+                int offset = pos & (disk->sector_size - 1);
+                uint32_t bytes;
+                if (in && offset == 0 && n >= disk->sector_size) {
+                        int sectors = n >> disk->sector_shift;
+                        bytes = sectors << disk->sector_shift;
+                        rc = disk_write_block(disk, lba, sectors, (void *)in);
+                } else {
+                        bytes = disk->sector_size - offset;
+                        if (bytes > n)
+                                bytes = n;
+
+                        if (bytes < disk->sector_size && (rc = disk_read_block(disk, lba, 1, sector_buffer)) < 0)
+                                return rc;
+
+                        if (in)
+                                memcpy(sector_buffer + offset, (void *)in, bytes);
+                        else
+                                memset(sector_buffer + offset, 0, bytes);
+                        rc = disk_write_block(disk, lba, 1, sector_buffer);
+                }
+
+                if (rc < 0)
+                        return rc;
+
+                pos += bytes;
+                n -= bytes;
+                if (in)
+                        in += bytes;
+        }
+
+        return 0;
+}
+
+/* Writes n bytes from in (or zeros if in is 0) to file, starting offset bytes into the file.
+ * The file's cluster chain must already be long enough.
+ * Each piece of the write that falls in one extent is a single contiguous write.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_write_file(struct disk *disk, struct fat_file *file, uint32_t offset, uint32_t n, const char *in)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        int cluster_bytes_shift = fat_private->layout.cluster_bytes_shift;
+
+        int rc = 0;
+        while (n > 0) {
+                struct fat_extent *extent = fat16_find_extent(file, offset >> cluster_bytes_shift);
+                if (!extent)
+                        return -EIO;
+
+                uint32_t offset_in_extent = offset - (extent->file_cluster << cluster_bytes_shift);
+                uint32_t bytes_to_write = (extent->count << cluster_bytes_shift) - offset_in_extent;
+                if (bytes_to_write > n)
+                        bytes_to_write = n;
+
+                uint64_t pos = fat16_cluster_to_absolute_pos(disk, extent->cluster, offset_in_extent);
+                if ((rc = fat16_write_bytes(disk, pos, bytes_to_write, in)) < 0)
+                        return rc;
+
+                offset += bytes_to_write;
+                n -= bytes_to_write;
+                if (in)
+                        in += bytes_to_write;
+        }
+
+        return 0;
+}
+
+/* Returns the # of clusters in the cluster chain of file */
+static uint32_t fat16_get_file_clusters(struct fat_file *file)
+{
+        if (file->total_extents == 0)
+                return 0;
+
+        struct fat_extent *last = &file->extents[file->total_extents - 1];
+        return last->file_cluster + last->count;
+}
+
+/* Adds the run of count clusters starting at cluster to the end of file's extents.  Returns 0 on success or < 0 on failure */
+static int fat16_append_extent(struct fat_file *file, uint32_t cluster, uint32_t count)
+{
+        uint32_t file_cluster = fat16_get_file_clusters(file);
+        if (file->total_extents > 0) {
+                struct fat_extent *last = &file->extents[file->total_extents - 1];
+                if (last->cluster + last->count == cluster) {
+                        last->count += count;
+                        return 0;
+                }
+        }
+
+        if (file->total_extents == file->extents_capacity) {
+                int capacity = file->extents_capacity ? file->extents_capacity * 2 : FAT_EXTENTS_MIN_CAPACITY;
+                struct fat_extent *extents = kzalloc(capacity * sizeof(struct fat_extent));
+                if (!extents)
+                        return -ENOMEM;
+
+                if (file->extents) {
+                        memcpy(extents, file->extents, file->total_extents * sizeof(struct fat_extent));
+                        kfree(file->extents);
+                }
+                file->extents = extents;
+                file->extents_capacity = capacity;
+        }
+
+        struct fat_extent *extent = &file->extents[file->total_extents++];
+        extent->file_cluster = file_cluster;
+        extent->cluster = cluster;
+        extent->count = count;
+        return 0;
+}
+
+/* Grows the cluster chain of file to total clusters.
+ * Everything the file still needs is asked for as one contiguous run, starting at the file's next-cluster hint.
+ * If the disk can't give one run that long, the file grows by several runs, each as long as possible.
+ * A run placed in a new spot reserves room after it for the file to keep growing: as many clusters as the file
+ * will then have (at least FAT_ALLOC_RESERVE_CLUSTERS), so a file that keeps growing moves a logarithmic # of times.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_extend_file(struct disk *disk, struct fat_file *file, uint32_t total)
+{
+        struct fat_directory_entry *raw_entry = file->easy_directory_entry->entry;
+        int rc = 0;
+
+        for (uint32_t clusters = fat16_get_file_clusters(file); clusters < total; ) {
+                int last_cluster = 0;
+                if (file->total_extents > 0) {
+                        struct fat_extent *last = &file->extents[file->total_extents - 1];
+                        last_cluster = last->cluster + last->count - 1;
+                }
+                if (!file->next_cluster_hint && last_cluster)
+                        file->next_cluster_hint = last_cluster + 1;
+
+                int reserve = total > FAT_ALLOC_RESERVE_CLUSTERS ? total : FAT_ALLOC_RESERVE_CLUSTERS;
+                int count = 0;
+                int cluster = fat16_alloc_run(disk, file->next_cluster_hint, total - clusters, reserve, &count);
+                if (cluster < 0)
+                        return cluster;
+
+                if (last_cluster) {
+                        fat16_set_fat_entry(disk, last_cluster, cluster);
+                } else {
+                        fat16_set_first_cluster(raw_entry, cluster);
+                }
+
+                if ((rc = fat16_append_extent(file, cluster, count)) < 0)
+                        return rc;
+
+                file->next_cluster_hint = cluster + count;
+                clusters += count;
+        }
+
+        return 0;
+}
+
+/* Starts it at the first entry of the directory whose first cluster is first_cluster (0 for the root directory) */
+static void fat16_directory_iterator_init(struct disk *disk, uint32_t first_cluster, struct fat_directory_iterator *it)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        if (first_cluster == 0)
+                first_cluster = fat_private->root_cluster;
+
+        it->disk = disk;
+        it->first_cluster = first_cluster;
+        it->cluster = first_cluster;
+        it->cluster_first_pos = 0;
+        it->pos = 0;
+}
+
+/* Moves it so that the next entry it reads is entry pos */
+static void fat16_directory_iterator_seek(struct fat_directory_iterator *it, uint32_t pos)
+{
+        /* The cluster chain can only be walked forwards */
+        if (pos < it->cluster_first_pos) {
+                it->cluster = it->first_cluster;
+                it->cluster_first_pos = 0;
+        }
+
+        it->pos = pos;
+}
+
+/* Reads the next entry of the directory to out and advances it.
+ * Free entries are returned too, but the end of directory marker isn't: once it's reached, it stays there.
+ * The end of the directory is also reached when the root directory region or the cluster chain runs out (it->at_end_marker tells them apart).
+ * Returns 1 if an entry was read, 0 at the end of the directory, or < 0 on failure
+ */
+static int fat16_directory_iterator_next(struct fat_directory_iterator *it, struct fat_directory_entry *out)
+{
+        struct disk *disk = it->disk;
+        struct fat_private *fat_private = disk->fs_private;
+        int rc = 0;
+
+        it->at_end_marker = false;
+
+        uint64_t pos;
+        if (it->first_cluster == 0) {
+                if (it->pos >= fat_private->header.fat_header_primary.root_dir_entries)
+                        return 0;
+
+                pos = fat16_sector_to_absolute_pos(disk, fat_private->root_directory.sector) + it->pos * sizeof(struct fat_directory_entry);
+        } else {
+                uint32_t entries_per_cluster = fat_private->layout.cluster_size / sizeof(struct fat_directory_entry);
+                while (it->pos - it->cluster_first_pos >= entries_per_cluster) {
+                        int next = fat16_get_fat_entry(disk, it->cluster);
+                        if (next < 0)
+                                return next;
+                        if (!fat16_is_next_cluster(fat_private, next))
+                                return 0;       // The chain ends without an end of directory marker
+
+                        it->cluster = next;
+                        it->cluster_first_pos += entries_per_cluster;
+                }
+
+                pos = fat16_cluster_to_absolute_pos(disk, it->cluster, (it->pos - it->cluster_first_pos) * sizeof(struct fat_directory_entry));
+        }
+
+        struct disk_stream *directory_stream = fat_private->directory_stream;
+        if ((rc = disk_stream_seek(directory_stream, pos)) < 0)
+                return rc;
+        if ((rc = disk_stream_read(directory_stream, out, sizeof(struct fat_directory_entry))) < 0)
+                return rc;
+
+        it->entry_pos = pos;
+
+        /* If the first byte of the entry is 0, then there are no more entries in this directory */
+        if (out->filename[0] == 0x00) {
+                it->at_end_marker = true;
+                return 0;
+        }
+
+        it->pos++;
+        return 1;
+}
+
+/* Reads entry pos of directory, and where it is, to out.  Returns 1 if it was read, 0 if it's past the end of the directory, or < 0 on failure */
+static int fat16_read_directory_entry(struct disk *disk, struct fat_directory *directory, uint32_t pos, struct fat_dentry *out)
+{
+        struct fat_directory_iterator it;
+        fat16_directory_iterator_init(disk, directory->cluster, &it);
+        fat16_directory_iterator_seek(&it, pos);
+        int rc = fat16_directory_iterator_next(&it, &out->entry);
+        out->parent = directory->cluster;
+        out->entry_pos = it.entry_pos;
+        out->index = pos;
+        out->long_name_entries = 0;
+        return rc;
+}
+
+/* Adds slot (whose entry is an entry index + 1) to directory's name index, doubling the index if it would become more than half full.
+ * If there isn't memory to grow the index, the slot still goes in as long as one is left.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_index_insert(struct fat_directory *directory, struct fat_index_slot *slot)
+{
+        struct fat_index_slot *index = 0;
+        if ((directory->index_count + 1) * 2 > directory->index_mask + 1)
+                index = kzalloc((directory->index_mask + 1) * 2 * sizeof(struct fat_index_slot));
+
+        if (index) {
+                struct fat_index_slot *old_index = directory->index;
+                int old_slots = directory->index_mask + 1;
+                directory->index = index;
+                directory->index_mask = old_slots * 2 - 1;
+                directory->index_count = 0;
+                for (int i = 0; i < old_slots; i++) {
+                        if (old_index[i].entry)
+                                fat16_index_insert(directory, &old_index[i]);
+                }
+                kfree(old_index);
+        } else if (directory->index_count + 1 >= directory->index_mask + 1) {
+                return -ENOMEM;
+        }
+
+        uint32_t i = slot->hash & directory->index_mask;
+        while (directory->index[i].entry)
+                i = (i + 1) & directory->index_mask;
+
+        directory->index[i] = *slot;
+        directory->index_count++;
+        return 0;
+}
+
+/* Finds the first entry in directory whose normalized 8.3 name is key (with hash hash) using the name index, and reads it to out.
+ * Returns 1 if it's found, 0 if it isn't, or < 0 on failure
+ */
+static int fat16_index_find(struct disk *disk, struct fat_directory *directory, const char *key, uint32_t hash, struct fat_dentry *out)
+{
+        char entry_name[FAT_83_NAME_LEN];
+        uint32_t slot = hash & directory->index_mask;
+        for (; directory->index[slot].entry; slot = (slot + 1) & directory->index_mask) {
+                if (directory->index[slot].hash != hash || directory->index[slot].long_name)
+                        continue;
+
+                int rc = fat16_read_directory_entry(disk, directory, directory->index[slot].entry - 1, out);
+                if (rc < 0)
+                        return rc;
+
+                fat16_get_normalized_name(&out->entry, entry_name);
+                if (rc > 0 && memcmp((void *)key, entry_name, FAT_83_NAME_LEN) == 0) {
+                        out->long_name_entries = directory->index[slot].long_name_entries;
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+/* Returns the slot of the first long name in directory that matches name (ignoring case), or 0 if there's none.
+ * Only the decoded names in memory are compared, so the entry may have been deleted or replaced since the directory was loaded.
+ */
+static struct fat_index_slot *fat16_index_find_long_name(struct fat_directory *directory, const char *name, uint32_t hash)
+{
+        uint32_t slot = hash & directory->index_mask;
+        for (; directory->index[slot].entry; slot = (slot + 1) & directory->index_mask) {
+                struct fat_index_slot *candidate = &directory->index[slot];
+                if (candidate->hash == hash && candidate->long_name &&
+                    strnicmp(directory->long_names + candidate->long_name - 1, name, directory->long_names_size) == 0)
+                        return candidate;
+        }
+
+        return 0;
+}
+
+/* Finds the first entry in directory whose long file name is name, and reads it to out.
+ * The entry and the long file name entry in front of it are read back to check that they still belong together.
+ * Returns 1 if it's found, 0 if it isn't, or < 0 on failure
+ */
+static int fat16_index_find_long(struct disk *disk, struct fat_directory *directory, const char *name, struct fat_dentry *out)
+{
+        if (!directory->long_names)
+                return 0;
+
+        struct fat_index_slot *slot = fat16_index_find_long_name(directory, name, fat16_hash_long_name(name));
+        if (!slot || slot->entry < 2)
+                return 0;
+
+        struct fat_dentry lfn;
+        int rc = fat16_read_directory_entry(disk, directory, slot->entry - 2, &lfn);
+        if (rc <= 0)
+                return rc;
+        if ((rc = fat16_read_directory_entry(disk, directory, slot->entry - 1, out)) <= 0)
+                return rc;
 
+        struct fat_long_name_entry *first = (struct fat_long_name_entry *)&lfn.entry;
+        if (!fat16_is_named_entry(&out->entry) || !fat16_is_long_name_entry(&lfn.entry) ||
+            (first->ordinal & FAT_LFN_ORDINAL_MASK) != 1 || first->checksum != fat16_short_name_checksum(&out->entry))
+                return 0;
+
+        out->long_name_entries = slot->long_name_entries;
+        return 1;
+}
+
+/* Builds directory's hash index of 8.3 names and long file names by streaming through its entries once, and counts its entries.
+ * Long file names are validated against the checksum of the 8.3 name they belong to, decoded, and kept with the directory.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_build_directory_index(struct disk *disk, struct fat_directory *directory)
+{
+        directory->index = kzalloc(FAT_DIRECTORY_INDEX_MIN_SLOTS * sizeof(struct fat_index_slot));
+        if (!directory->index)
+                return -ENOMEM;
+        directory->index_mask = FAT_DIRECTORY_INDEX_MIN_SLOTS - 1;
+        directory->index_count = 0;
+
+        struct fat_long_name_decoder *decoder = kzalloc(sizeof(struct fat_long_name_decoder));
+        if (!decoder)
+                return -ENOMEM;
+
+        struct fat_directory_iterator it;
+        struct fat_directory_entry raw_entry;
+        struct fat_dentry other;
+        char name[FAT_83_NAME_LEN];
         int rc = 0;
-        if ((rc = disk_stream_seek(cluster_read_stream, start_pos_bytes)) < 0)
+        fat16_directory_iterator_init(disk, directory->cluster, &it);
+        while ((rc = fat16_directory_iterator_next(&it, &raw_entry)) > 0) {
+                if (!fat16_is_named_entry(&raw_entry)) {
+                        fat16_long_name_decode(decoder, &raw_entry);
+                        continue;
+                }
+
+                int long_name_entries = decoder->entries;
+                int long_name = fat16_long_name_finish(directory, decoder, &raw_entry);
+                if (long_name < 0) {
+                        rc = long_name;
+                        break;
+                }
+
+                struct fat_index_slot slot = { .entry = it.pos, .long_name = long_name, .long_name_entries = long_name ? long_name_entries : 0 };
+                if (long_name) {
+                        /* A lookup returns the first entry with a given name, so later duplicates aren't indexed */
+                        const char *long_name_str = directory->long_names + long_name - 1;
+                        slot.hash = fat16_hash_long_name(long_name_str);
+                        if (!fat16_index_find_long_name(directory, long_name_str, slot.hash) && (rc = fat16_index_insert(directory, &slot)) < 0)
+                                break;
+                }
+
+                fat16_get_normalized_name(&raw_entry, name);
+                slot.hash = fat16_hash_name(name);
+                slot.long_name = 0;
+                if ((rc = fat16_index_find(disk, directory, name, slot.hash, &other)) < 0)
+                        break;
+                if (rc > 0)
+                        continue;
+
+                if ((rc = fat16_index_insert(directory, &slot)) < 0)
+                        break;
+        }
+
+        kfree(decoder);
+        if (rc < 0)
                 return rc;
-        if ((rc = disk_stream_read(cluster_read_stream, out, bytes_to_read)) < 0)
+
+        directory->total = it.pos;
+        return 0;
+}
+
+/* Free the allocated memory associated with easy_dir_entry */
+static void fat16_easy_dir_entry_free(struct fat_easy_directory_entry *easy_dir_entry)
+{
+        if (easy_dir_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
+                fat16_free_directory(easy_dir_entry->directory);
+        } else if (easy_dir_entry->type == FAT_ITEM_TYPE_FILE) {
+                kfree(easy_dir_entry->entry);
+        } else {
+                // panic() --> have to implement this
+        }
+
+        kfree(easy_dir_entry);
+}
+
+/* Creates and initializes a fat_directory instance for the subdirectory whose first cluster is cluster
+ * Returns 0 (NULL) on error.
+ */
+static struct fat_directory *fat16_new_directory(struct disk *disk, uint32_t cluster)
+{
+        struct fat_directory *directory = 0;
+        struct fat_private *fat_private = disk->fs_private;
+        directory = kzalloc(sizeof (struct fat_directory));
+        if (!directory)
+                return NULL;
+
+        directory->cluster = cluster;
+        directory->sector = fat16_cluster_to_start_sector(fat_private, directory->cluster);
+        int rc = fat16_build_directory_index(disk, directory);
+        if (rc < 0) {
+                fat16_free_directory(directory);
+                return NULL;
+        }
+
+        return directory;
+}
+
+/* Creates and initializes a fat_directory instance which corresponds to the directory represented by raw_entry 
+ * Returns 0 (NULL) on error.
+ */
+static struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_directory_entry *raw_entry)
+{
+        if (!(raw_entry->attribute & FAT_FILE_SUBDIRECTORY))
+                return NULL;
+
+        return fat16_new_directory(disk, fat16_get_first_cluster(raw_entry));
+}
+
+/* Returns the subdirectory whose first cluster is cluster from fat_private->directory_cache, loading it into the cache if necessary.
+ * The directory belongs to the cache and must not be freed by the caller.
+ * Returns 0 (NULL) on error.
+ */
+static struct fat_directory *fat16_get_cached_directory(struct disk *disk, uint32_t cluster)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        struct fat_directory **cache = fat_private->directory_cache;
+
+        /* Stop at the cached copy, the first free slot, or the least recently used slot */
+        int i = 0;
+        while (i < FAT_DIRECTORY_CACHE_SIZE - 1 && cache[i] && cache[i]->cluster != cluster)
+                i++;
+
+        struct fat_directory *directory = cache[i];
+        if (!directory || directory->cluster != cluster) {
+                directory = fat16_new_directory(disk, cluster);
+                if (!directory)
+                        return NULL;
+
+                fat16_free_directory(cache[i]);
+        }
+
+        for (; i > 0; i--)
+                cache[i] = cache[i - 1];
+        cache[0] = directory;
+
+        return directory;
+}
+
+/* Returns the loaded directory whose first cluster is cluster (the root directory if cluster is 0), or 0 if it isn't loaded.
+ * Nothing is read from disk.
+ */
+static struct fat_directory *fat16_find_loaded_directory(struct fat_private *fat_private, uint32_t cluster)
+{
+        if (cluster == 0)
+                return &fat_private->root_directory;
+
+        for (int i = 0; i < FAT_DIRECTORY_CACHE_SIZE; i++) {
+                if (fat_private->directory_cache[i] && fat_private->directory_cache[i]->cluster == cluster)
+                        return fat_private->directory_cache[i];
+        }
+
+        return 0;
+}
+
+/* Creates and returns a fat_easy_directory_entry instance corresponding with the fat_directory_entry raw_entry 
+ * Returns 0 on failure
+*/
+static struct fat_easy_directory_entry *fat16_get_easy_entry(struct disk *disk, struct fat_directory_entry *raw_entry)
+{
+        struct fat_easy_directory_entry *easy_entry = kzalloc(sizeof(struct fat_easy_directory_entry));
+        if (!easy_entry)
+                return 0;
+
+        if (raw_entry->attribute & FAT_FILE_SUBDIRECTORY) {
+                easy_entry->directory = fat16_load_fat_directory(disk, raw_entry);
+                easy_entry->type = FAT_ITEM_TYPE_DIRECTORY;
+        } else {
+                easy_entry->type = FAT_ITEM_TYPE_FILE;
+                /* Since raw_entry might be deleted after this function is called, we need to make sure we store a copy of it */
+                easy_entry->entry = fat16_clone_raw_dir_entry(raw_entry, sizeof(struct fat_directory_entry));                                            
+        }
+
+        return easy_entry;
+}
+
+/* Copies the first raw entry in directory that is associated with name to out, using the directory's name index.
+ * name may be an 8.3 name or a long file name.
+ * Returns 1 if it's found, 0 if the entry name does not exist in directory, or < 0 on failure
+ */
+static int fat16_find_entry_in_directory(struct disk *disk, struct fat_directory *directory, const char *name, struct fat_dentry *out)
+{
+        char key[FAT_83_NAME_LEN];
+        if (fat16_normalize_name(name, key) == 0) {
+                int rc = fat16_index_find(disk, directory, key, fat16_hash_name(key), out);
+                if (rc != 0)
+                        return rc;
+        }
+
+        return fat16_index_find_long(disk, directory, name, out);
+}
+
+/* Looks up name in the directory whose first cluster is parent (0 for the root directory), and copies what it finds to out.
+ * The result is taken from the dcache when possible.  Otherwise the directory is searched (loading it into the directory cache if needed),
+ * and the result (found or not) is added to the dcache.
+ * Returns 1 if name was found, 0 if it doesn't exist, or < 0 on failure
+ */
+static int fat16_lookup(struct disk *disk, uint32_t parent, const char *name, struct fat_dentry *out)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        struct dentry *dentry = dcache_lookup(disk, parent, name);
+        if (dentry) {
+                if (dentry->negative)
+                        return 0;
+
+                memcpy(out, dentry->data, sizeof(struct fat_dentry));
+                return 1;
+        }
+
+        /* A ".." entry that refers to the root directory has a first cluster of 0 */
+        struct fat_directory *directory = &fat_private->root_directory;
+        if (parent) {
+                directory = fat16_get_cached_directory(disk, parent);
+                if (!directory)
+                        return -EIO;
+        }
+
+        int rc = fat16_find_entry_in_directory(disk, directory, name, out);
+        if (rc < 0)
                 return rc;
-        
-        n -= bytes_to_read;
-        if (n > 0) {
-                /* There is still more to read 
-                 * TODO: this could be bad for stack space.
-                 */
-                rc = fat16_read_internal(disk, chain_start_cluster, offset + bytes_to_read, n, out + bytes_to_read);
+
+        if (rc == 0)
+                dcache_insert(disk, parent, name, 0, 0);
+        else
+                dcache_insert(disk, parent, name, out, sizeof(struct fat_dentry));
+
+        return rc;
+}
+
+/* Walks every part of path but the last one, one raw entry at a time, so that intermediate directories are only read
+ * when their lookups aren't already in the dcache.
+ * Sets *parent to the first cluster of the directory that the last part belongs in (0 for the root directory), and *name to the last part.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_lookup_parent(struct disk *disk, struct path_part *path, uint32_t *parent, const char **name)
+{
+        struct fat_dentry dentry;
+        *parent = 0;
+        for (; path->next; path = path->next) {
+                int rc = fat16_lookup(disk, *parent, path->part, &dentry);
                 if (rc < 0)
                         return rc;
+                if (rc == 0)
+                        return -EIO;
+
+                /* Since there's another part after this one, this entry must be a directory */
+                if (!(dentry.entry.attribute & FAT_FILE_SUBDIRECTORY))
+                        return -EBADPATH;
+
+                *parent = fat16_get_first_cluster(&dentry.entry);
         }
 
-        return rc;
+        *name = path->part;
+        return 0;
 }
 
-/* Frees the allocated memory associated with directory */
-static void fat16_free_directory(struct fat_directory *directory)
+/* Writes dentry's entry back to its place on disk and refreshes its dcache entry.  Returns 0 on success or < 0 on failure */
+static int fat16_write_dentry(struct disk *disk, struct fat_dentry *dentry)
 {
-        if (!directory)
-                return;
+        int rc = fat16_write_bytes(disk, dentry->entry_pos, sizeof(struct fat_directory_entry), (const char *)&dentry->entry);
+        if (rc < 0)
+                return rc;
 
-        if (directory->entry)
-                kfree(directory->entry);
+        /* The entry may also be cached under its long name (in any spelling), so drop the lookups of its whole directory */
+        if (dentry->long_name_entries)
+                dcache_invalidate_directory(disk, dentry->parent);
 
-        kfree(directory);
+        char filename[MAX_FILE_PATH_CHARS];
+        fat16_get_filename(&dentry->entry, filename, sizeof(filename));
+        dcache_insert(disk, dentry->parent, filename, dentry, sizeof(struct fat_dentry));
+        return 0;
 }
 
-/* Free the allocated memory associated with easy_dir_entry */
-static void fat16_easy_dir_entry_free(struct fat_easy_directory_entry *easy_dir_entry)
+/* Writes the directory entry of file back to disk.  Returns 0 on success or < 0 on failure */
+static int fat16_write_file_entry(struct disk *disk, struct fat_file *file)
 {
-        if (easy_dir_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
-                fat16_free_directory(easy_dir_entry->directory);
-        } else if (easy_dir_entry->type == FAT_ITEM_TYPE_FILE) {
-                kfree(easy_dir_entry->entry);
-        } else {
-                // panic() --> have to implement this
-        }
-
-        kfree(easy_dir_entry);
+        struct fat_dentry dentry;
+        dentry.entry = *file->easy_directory_entry->entry;
+        dentry.parent = file->parent;
+        dentry.entry_pos = file->entry_pos;
+        dentry.index = file->index;
+        dentry.long_name_entries = file->long_name_entries;
+        return fat16_write_dentry(disk, &dentry);
 }
 
-/* Creates and initializes a fat_directory instance which corresponds to the directory represented by raw_entry 
- * Returns 0 (NULL) on error.
+/* Finds room for a new entry in the directory whose first cluster is parent (0 for the root directory).
+ * Free entries are reused first.  A subdirectory with no room left grows by a cluster.
+ * Sets *pos to the absolute position of the room on disk and *index to its index in the directory.
+ * Returns 0 on success or < 0 on failure (-ENOSPC if the FAT16 root directory is full)
  */
-static struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_directory_entry *raw_entry)
+static int fat16_find_free_entry(struct disk *disk, uint32_t parent, uint64_t *pos, uint32_t *index)
 {
-        struct fat_directory *directory = 0;
         struct fat_private *fat_private = disk->fs_private;
-        if (!(raw_entry->attribute & FAT_FILE_SUBDIRECTORY))
-                return NULL;
-
-        directory = kzalloc(sizeof (struct fat_directory));
-        if (!directory)
-                return NULL;
+        struct fat_directory_iterator it;
+        struct fat_directory_entry raw_entry;
+        int rc = 0;
 
-        int cluster = fat16_get_first_cluster(raw_entry);
-        int cluster_sector = fat16_cluster_to_start_sector(fat_private, cluster);
-        directory->total = fat16_get_total_items_for_directory(disk, cluster_sector);
-        int directory_size = directory->total * sizeof(struct fat_directory_entry);
-        directory->entry = kzalloc(directory_size);
-        if (!directory->entry) {
-                kfree(directory);
-                return NULL;
+        fat16_directory_iterator_init(disk, parent, &it);
+        while ((rc = fat16_directory_iterator_next(&it, &raw_entry)) > 0) {
+                if (raw_entry.filename[0] == FAT_DELETED_ENTRY) {
+                        *pos = it.entry_pos;
+                        *index = it.pos - 1;
+                        return 0;
+                }
         }
 
-        int rc = fat16_read_internal(disk, cluster, 0x00, directory_size, directory->entry);
-        if (rc < 0) {
-                fat16_free_directory(directory);
-                return NULL;
+        if (rc < 0)
+                return rc;
+
+        /* Entries after the end of directory marker are free too */
+        if (it.at_end_marker) {
+                *pos = it.entry_pos;
+                *index = it.pos;
+                return 0;
         }
 
-        return directory;
+        /* The FAT16 root directory can't grow */
+        if (it.first_cluster == 0)
+                return -ENOSPC;
+
+        /* Every cluster of the directory is full.  Link a new, zeroed cluster (which reads as the end of the directory) to the end of the chain */
+        int cluster = fat16_alloc_cluster(disk, it.cluster + 1);
+        if (cluster < 0)
+                return cluster;
+        fat16_set_fat_entry(disk, it.cluster, cluster);
+
+        *pos = fat16_cluster_to_absolute_pos(disk, cluster, 0);
+        *index = it.pos;
+        return fat16_write_bytes(disk, *pos, fat_private->layout.cluster_size, 0);
 }
 
-/* Creates and returns a fat_easy_directory_entry instance corresponding with the fat_directory_entry raw_entry 
- * Returns 0 on failure
-*/
-static struct fat_easy_directory_entry *fat16_get_easy_entry(struct disk *disk, struct fat_directory_entry *raw_entry)
+/* Creates an empty file called name in the directory whose first cluster is parent (0 for the root directory),
+ * and copies its new entry to out.  name must not already exist in the directory.
+ * Returns 0 on success or < 0 on failure
+ */
+static int fat16_create_entry(struct disk *disk, uint32_t parent, const char *name, struct fat_dentry *out)
 {
-        struct fat_easy_directory_entry *easy_entry = kzalloc(sizeof(struct fat_easy_directory_entry));
-        if (!easy_entry)
-                return 0;
+        struct fat_private *fat_private = disk->fs_private;
+        char key[FAT_83_NAME_LEN];
+        if (fat16_normalize_name(name, key) < 0 || key[0] == '.')
+                return -EINVARG;
 
-        if (raw_entry->attribute & FAT_FILE_SUBDIRECTORY) {
-                easy_entry->directory = fat16_load_fat_directory(disk, raw_entry);
-                easy_entry->type = FAT_ITEM_TYPE_DIRECTORY;
-        } else {
-                easy_entry->type = FAT_ITEM_TYPE_FILE;
-                /* Since raw_entry might be deleted after this function is called, we need to make sure we store a copy of it */
-                easy_entry->entry = fat16_clone_raw_dir_entry(raw_entry, sizeof(struct fat_directory_entry));                                            
+        uint32_t index = 0;
+        int rc = fat16_find_free_entry(disk, parent, &out->entry_pos, &index);
+        if (rc < 0)
+                return rc;
+
+        /* Names are stored in upper case */
+        memset(&out->entry, 0, sizeof(struct fat_directory_entry));
+        for (int i = 0; i < FAT_83_NAME_LEN; i++) {
+                char c = key[i] >= 'a' && key[i] <= 'z' ? key[i] - 'a' + 'A' : key[i];
+                if (i < 8)
+                        out->entry.filename[i] = c;
+                else
+                        out->entry.ext[i - 8] = c;
+        }
+        out->entry.attribute = FAT_FILE_ARCHIVED;
+        out->parent = parent;
+        out->index = index;
+        out->long_name_entries = 0;
+
+        /* name may differ in case from the stored name (e.g. "a" for "A"), so drop its negative lookup as well */
+        dcache_invalidate(disk, parent, name);
+        if ((rc = fat16_write_dentry(disk, out)) < 0)
+                return rc;
+
+        /* Keep the name index of the directory in step if it's loaded */
+        struct fat_directory *directory = fat16_find_loaded_directory(fat_private, parent);
+        if (directory) {
+                if (index + 1 > directory->total)
+                        directory->total = index + 1;
+                struct fat_index_slot slot = { .hash = fat16_hash_name(key), .entry = index + 1 };
+                rc = fat16_index_insert(directory, &slot);
         }
 
-        return easy_entry;
+        return rc;
 }
 
-/* Returns the directory entry in directory that is associated with name
- * Returns 0 if the entry name does not exist in directory
+/* Sets the size of file to length bytes.
+ * A shrinking file gives up the clusters it no longer needs.  A growing file is extended with zero bytes.
+ * Returns 0 on success or < 0 on failure
  */
-static struct fat_easy_directory_entry *fat16_find_entry_in_directory(struct disk *disk, struct fat_directory *directory,  const char *name)
+static int fat16_truncate_file(struct disk *disk, struct fat_file *file, uint32_t length)
 {
-        struct fat_easy_directory_entry *entry = 0;
-        char tmp_filename[MAX_FILE_PATH_CHARS];
+        struct fat_private *fat_private = disk->fs_private;
+        struct fat_directory_entry *raw_entry = file->easy_directory_entry->entry;
+        struct fat_layout *layout = &fat_private->layout;
+        uint32_t clusters = (length >> layout->cluster_bytes_shift) + ((length & layout->cluster_mask) != 0);
+        int rc = 0;
 
-        for (int i = 0; i < directory->total; i++) {
-                fat16_get_filename(&directory->entry[i], tmp_filename, sizeof(tmp_filename));
-                if (strnicmp(tmp_filename, name, sizeof(tmp_filename)) == 0) {
-                       entry = fat16_get_easy_entry(disk, &directory->entry[i]);
+        if (length > raw_entry->filesize) {
+                if ((rc = fat16_extend_file(disk, file, clusters)) < 0 ||
+                    (rc = fat16_write_file(disk, file, raw_entry->filesize, length - raw_entry->filesize, 0)) < 0)
+                        return rc;
+        } else if (clusters < fat16_get_file_clusters(file)) {
+                if (clusters == 0) {
+                        rc = fat16_free_chain(disk, fat16_get_first_cluster(raw_entry));
+                        fat16_set_first_cluster(raw_entry, 0);
+                } else {
+                        struct fat_extent *extent = fat16_find_extent(file, clusters - 1);
+                        int last_cluster = extent->cluster + (clusters - 1 - extent->file_cluster);
+                        int next = fat16_get_fat_entry(disk, last_cluster);
+                        fat16_set_fat_entry(disk, last_cluster, FAT_END_OF_CHAIN);
+                        rc = fat16_free_chain(disk, next);
                 }
+                if (rc < 0)
+                        return rc;
+
+                if (file->extents)
+                        kfree(file->extents);
+                rc = fat16_build_extents(disk, fat16_get_first_cluster(raw_entry), &file->extents, &file->total_extents);
+                file->extents_capacity = file->total_extents;
+                file->next_cluster_hint = 0;
+                if (rc < 0)
+                        return rc;
         }
-        
-        return entry;
+
+        raw_entry->filesize = length;
+        return fat16_write_file_entry(disk, file);
 }
 
-/* Returns the directory entry at the given path on disk.  Returns NULL (0) on error */
-static struct fat_easy_directory_entry *fat16_get_directory_entry(struct disk *disk, struct path_part *path)
+static void fat16_free_file(struct fat_file *file)
 {
-        struct fat_private *fat_private = disk->fs_private;
-        struct fat_easy_directory_entry *first_part_entry = fat16_find_entry_in_directory(disk, &fat_private->root_directory, path->part);
-                                                                                                                                        
-        if (!first_part_entry)
-                return 0;
+        if (file->extents)
+                kfree(file->extents);
+        fat16_easy_dir_entry_free(file->easy_directory_entry);
+        kfree(file);
+}
 
-        struct fat_easy_directory_entry *curr_part_entry = first_part_entry;
-        struct path_part *next_path_part = path->next;
-        while (next_path_part) {
-                if (curr_part_entry->type != FAT_ITEM_TYPE_DIRECTORY) {
-                        /* This indicates the path is invalid.  Since next_path_part has a value,
-                         * the type of this entry must be a directory
-                         */
-                        return NULL;
-                }
+/* Creates the state shared by every open of the file whose entry is dentry: a copy of its entry (or its loaded directory) and its extents.
+ * Returns the new fat_file instance, or < 0 on failure
+ */
+static struct fat_file *fat16_new_file(struct disk *disk, struct fat_dentry *dentry)
+{
+        struct fat_file *file = kzalloc(sizeof(struct fat_file));
+        if (!file)
+                return ERROR(-ENOMEM);
+
+        file->easy_directory_entry = fat16_get_easy_entry(disk, &dentry->entry);
+        if (!file->easy_directory_entry) {
+                kfree(file);
+                return ERROR(-EIO);
+        }
 
-                struct fat_easy_directory_entry *tmp_entry = fat16_find_entry_in_directory(disk, curr_part_entry->directory, next_path_part->part);
-                /* Since fat16_find_entry_in_directory dynamically creates the fat16 structures in memory on the fly, we should release 
-                 * the corresponding memory as we continue to traverse the path.
-                 */
-                fat16_easy_dir_entry_free(curr_part_entry);
-                curr_part_entry = tmp_entry;
-                next_path_part = next_path_part->next;
+        file->parent = dentry->parent;
+        file->entry_pos = dentry->entry_pos;
+        file->index = dentry->index;
+        file->long_name_entries = dentry->long_name_entries;
+
+        struct fat_easy_directory_entry *easy_entry = file->easy_directory_entry;
+        if (easy_entry->type == FAT_ITEM_TYPE_FILE) {
+                int rc = fat16_build_extents(disk, fat16_get_first_cluster(easy_entry->entry), &file->extents, &file->total_extents);
+                file->extents_capacity = file->total_extents;
+                if (rc < 0) {
+                        fat16_free_file(file);
+                        return ERROR(rc);
+                }
         }
 
-        return curr_part_entry;
+        return file;
+}
+
+/* Drops desc's reference to the vnode of its file, freeing the file's shared state along with the last reference, and frees desc */
+static void fat16_free_file_descriptor(struct fat_file_descriptor *desc)
+{
+        struct fat_file *file = desc->file;
+        if (vnode_put(desc->vnode))
+                fat16_free_file(file);
+        kfree(desc);
 }
 
-/* Creates a file descriptor corresponding to the file at path on disk 
- * Right now this filesystem implementation only supports file reads, so the only
- * allowed mode is READ.
+/* Creates a file descriptor corresponding to the file at path on disk.
+ * READ opens an existing file or directory.  WRITE and APPEND only open files, creating them if they don't exist,
+ * and WRITE truncates the file to 0 bytes (-EBUSY if the file is memory mapped).
+ * Every descriptor open on the same file shares the file's vnode, which is keyed by the position of the file's directory entry.
  * Returns an initialized fat_file_descriptor instance on success, or < 0 on failure
  */
 void *fat16_fopen(struct disk *disk, struct path_part *path, enum file_mode mode)
 {
-        /* We are only implementing reads in our filesystem for now */
-        if (mode != READ)
+        if (mode != READ && mode != WRITE && mode != APPEND)
+                return ERROR(-EINVARG);
+
+        uint32_t parent = 0;
+        const char *name = 0;
+        struct fat_dentry dentry;
+        int rc = fat16_lookup_parent(disk, path, &parent, &name);
+        if (rc < 0)
+                return ERROR(rc);
+
+        rc = fat16_lookup(disk, parent, name, &dentry);
+        if (rc < 0)
+                return ERROR(rc);
+        if (rc == 0) {
+                if (mode == READ)
+                        return ERROR(-EIO);
+
+                rc = fat16_create_entry(disk, parent, name, &dentry);
+                int flush_rc = fat16_flush_fat(disk);
+                if (rc < 0 || (rc = flush_rc) < 0)
+                        return ERROR(rc);
+        }
+
+        if (mode != READ && (dentry.entry.attribute & (FAT_FILE_SUBDIRECTORY | FAT_FILE_READ_ONLY)))
                 return ERROR(-ERDONLY);
 
         struct fat_file_descriptor *fat_file_descriptor = kzalloc(sizeof(struct fat_file_descriptor));
         if (!fat_file_descriptor) 
                 return ERROR(-ENOMEM);
 
-        fat_file_descriptor->easy_directory_entry = fat16_get_directory_entry(disk, path);
-        if (!fat_file_descriptor->easy_directory_entry) {
-                kfree(fat_file_descriptor);
-                return ERROR(-EIO);
+        /* If the file is already open, its shared state (which has the file's current size and extents) is used as is */
+        struct vnode *vnode = vnode_get(disk, dentry.entry_pos);
+        if (!vnode) {
+                struct fat_file *file = fat16_new_file(disk, &dentry);
+                if (IS_ERROR(file)) {
+                        kfree(fat_file_descriptor);
+                        return file;
+                }
+
+                vnode = vnode_new(disk, dentry.entry_pos, file);
+                if (!vnode) {
+                        fat16_free_file(file);
+                        kfree(fat_file_descriptor);
+                        return ERROR(-ENOMEM);
+                }
         }
-                
 
+        fat_file_descriptor->vnode = vnode;
+        fat_file_descriptor->file = vnode->private;
         fat_file_descriptor->pos = 0;
+        fat_file_descriptor->mode = mode;
+
+        struct fat_easy_directory_entry *easy_entry = fat_file_descriptor->file->easy_directory_entry;
+        if (mode == WRITE && easy_entry->entry->filesize > 0) {
+                if (vnode->mappings > 0) {
+                        fat16_free_file_descriptor(fat_file_descriptor);
+                        return ERROR(-EBUSY);
+                }
+
+                fat_file_descriptor->written = true;
+                rc = fat16_truncate_file(disk, fat_file_descriptor->file, 0);
+                int flush_rc = fat16_flush_fat(disk);
+                if (rc < 0 || (rc = flush_rc) < 0) {
+                        fat16_free_file_descriptor(fat_file_descriptor);
+                        return ERROR(rc);
+                }
+        }
 
         return fat_file_descriptor;
 }
@@ -641,30 +2290,234 @@ void *fat16_fopen(struct disk *disk, struct path_part *path, enum file_mode mode
  * storing them at the location given by out.
  * This function can only be called on a file, not a directory.
  * 
+ * The whole range is read with one extent-based transfer, and the file position advances past the items read.
  * 
  * Returns the count of size elements that were read.
- * This may not always equal nmemb since an error or end-of-file may occur after some
- * elements have already been read.  Therefore, to check for failure, 
- * look for a short item count return value (or < 0)
+ * This may be less than nmemb if end-of-file comes first (a partial item at end-of-file is not read).
+ * Returns < 0 if the read fails
  */
 size_t fat16_fread(struct disk *disk, void *descriptor, size_t size, size_t nmemb, char *out)
 {
         struct fat_file_descriptor *desc = descriptor;
-        if (desc->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
+        if (desc->file->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
                 return -EINVARG;
         }
-        struct fat_directory_entry *raw_entry = desc->easy_directory_entry->entry;
-        int offset = desc->pos;
-        size_t count = 0;
-        for (count = 0; count < nmemb; count++) {
-                if (fat16_read_internal(disk, fat16_get_first_cluster(raw_entry), offset, size, out) < 0)
-                        return count;
-                out += size;
-                offset += size;
-        }
+        struct fat_directory_entry *raw_entry = desc->file->easy_directory_entry->entry;
+
+        /* Only whole items are read, and only as many as fit before end-of-file */
+        if (size == 0 || desc->pos >= raw_entry->filesize)
+                return 0;
+
+        size_t count = (raw_entry->filesize - desc->pos) / size;
+        if (count > nmemb)
+                count = nmemb;
+        if (count == 0)
+                return 0;
+
+        int rc = fat16_read_file(disk, desc->file, desc->pos, count * size, out);
+        if (rc < 0)
+                return rc;
+
+        desc->pos += count * size;
         return count;
 }
 
+/* fat16_fwrite - binary stream output
+ *
+ * Writes nmemb items of data, each size bytes long, from in to the stream associated with descriptor
+ * (a fat_file_descriptor instance), growing the file as needed.  In APPEND mode every write goes to end-of-file.
+ * The file position advances past the items written.
+ *
+ * Clusters are allocated for the whole write up front, and the FAT sectors it changes are written back once at the end.
+ *
+ * Returns nmemb on success or < 0 on failure (-EBUSY if the file is memory mapped)
+ */
+size_t fat16_fwrite(struct disk *disk, void *descriptor, size_t size, size_t nmemb, const char *in)
+{
+        struct fat_file_descriptor *desc = descriptor;
+        if (desc->file->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY || desc->mode == READ)
+                return -ERDONLY;
+        if (desc->vnode->mappings > 0)
+                return -EBUSY;
+
+        struct fat_private *fat_private = disk->fs_private;
+        struct fat_directory_entry *raw_entry = desc->file->easy_directory_entry->entry;
+        uint64_t n = (uint64_t)size * nmemb;
+        if (n == 0)
+                return 0;
+
+        if (desc->mode == APPEND)
+                desc->pos = raw_entry->filesize;
+
+        /* FAT file sizes are 32-bit */
+        if ((uint64_t)desc->pos + n > 0xFFFFFFFF)
+                return -EINVARG;
+        uint32_t end = desc->pos + n;
+
+        struct fat_layout *layout = &fat_private->layout;
+        int rc = 0;
+        if (end > raw_entry->filesize) {
+                rc = fat16_extend_file(disk, desc->file, (end >> layout->cluster_bytes_shift) + ((end & layout->cluster_mask) != 0));
+
+                /* Give back whatever part of the write's clusters could be allocated */
+                if (rc < 0)
+                        fat16_truncate_file(disk, desc->file, raw_entry->filesize);
+        }
+
+        /* A write past end-of-file leaves a gap that reads back as zeros */
+        if (rc >= 0 && desc->pos > raw_entry->filesize)
+                rc = fat16_write_file(disk, desc->file, raw_entry->filesize, desc->pos - raw_entry->filesize, 0);
+
+        if (rc >= 0)
+                rc = fat16_write_file(disk, desc->file, desc->pos, n, in);
+
+        if (rc >= 0 && end > raw_entry->filesize) {
+                raw_entry->filesize = end;
+                rc = fat16_write_file_entry(disk, desc->file);
+        }
+
+        desc->written = true;
+        int flush_rc = fat16_flush_fat(disk);
+        if (rc < 0 || (rc = flush_rc) < 0)
+                return rc;
+
+        desc->pos = end;
+        return nmemb;
+}
+
+/* fat16_ftruncate - set the size of a file
+ *
+ * Shrinks or grows the file associated with private (a fat_file_descriptor instance) to length bytes.
+ * Bytes added to the file read back as zeros.  The file position isn't changed.
+ *
+ * Returns 0 on success or < 0 on failure (-EBUSY if the file is memory mapped)
+ */
+int fat16_ftruncate(struct disk *disk, void *private, size_t length)
+{
+        struct fat_file_descriptor *desc = private;
+        if (desc->file->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY || desc->mode == READ)
+                return -ERDONLY;
+        if (desc->vnode->mappings > 0)
+                return -EBUSY;
+
+        int rc = fat16_truncate_file(disk, desc->file, length);
+        int flush_rc = fat16_flush_fat(disk);
+        if (rc < 0 || (rc = flush_rc) < 0)
+                return rc;
+
+        return disk_sync(disk);
+}
+
+/* fat16_create - create an empty file
+ *
+ * Creates an empty file at path.  Returns 0 on success, -EISTAKEN if path already exists, or < 0 on failure
+ */
+int fat16_create(struct disk *disk, struct path_part *path)
+{
+        uint32_t parent = 0;
+        const char *name = 0;
+        struct fat_dentry dentry;
+        int rc = fat16_lookup_parent(disk, path, &parent, &name);
+        if (rc < 0)
+                return rc;
+
+        rc = fat16_lookup(disk, parent, name, &dentry);
+        if (rc < 0)
+                return rc;
+        if (rc > 0)
+                return -EISTAKEN;
+
+        rc = fat16_create_entry(disk, parent, name, &dentry);
+        int flush_rc = fat16_flush_fat(disk);
+        if (rc < 0 || (rc = flush_rc) < 0)
+                return rc;
+
+        return disk_sync(disk);
+}
+
+/* Marks the long file name entries in front of dentry's entry as deleted.  Returns 0 on success or < 0 on failure */
+static int fat16_delete_long_name(struct disk *disk, struct fat_dentry *dentry)
+{
+        struct fat_private *fat_private = disk->fs_private;
+        struct fat_directory *directory = &fat_private->root_directory;
+        if (dentry->parent) {
+                directory = fat16_get_cached_directory(disk, dentry->parent);
+                if (!directory)
+                        return -EIO;
+        }
+
+        uint8_t deleted = FAT_DELETED_ENTRY;
+        struct fat_dentry lfn;
+        for (uint32_t i = 1; i <= dentry->long_name_entries && i <= dentry->index; i++) {
+                int rc = fat16_read_directory_entry(disk, directory, dentry->index - i, &lfn);
+                if (rc < 0)
+                        return rc;
+                if (rc == 0 || !fat16_is_long_name_entry(&lfn.entry))
+                        break;
+
+                if ((rc = fat16_write_bytes(disk, lfn.entry_pos, 1, (const char *)&deleted)) < 0)
+                        return rc;
+        }
+
+        return 0;
+}
+
+/* fat16_unlink - delete a file
+ *
+ * Frees the clusters of the file at path and marks its directory entry as deleted.
+ * Directories and files that are open can't be unlinked (-EBUSY for an open file).
+ *
+ * Returns 0 on success or < 0 on failure
+ */
+int fat16_unlink(struct disk *disk, struct path_part *path)
+{
+        uint32_t parent = 0;
+        const char *name = 0;
+        struct fat_dentry dentry;
+        int rc = fat16_lookup_parent(disk, path, &parent, &name);
+        if (rc < 0)
+                return rc;
+
+        rc = fat16_lookup(disk, parent, name, &dentry);
+        if (rc < 0)
+                return rc;
+        if (rc == 0)
+                return -EIO;
+
+        if (dentry.entry.attribute & FAT_FILE_SUBDIRECTORY)
+                return -EINVARG;
+        if (dentry.entry.attribute & FAT_FILE_READ_ONLY)
+                return -ERDONLY;
+
+        /* The clusters of an open file can't be given away under it */
+        struct vnode *vnode = vnode_get(disk, dentry.entry_pos);
+        if (vnode) {
+                vnode_put(vnode);
+                return -EBUSY;
+        }
+
+        rc = fat16_free_chain(disk, fat16_get_first_cluster(&dentry.entry));
+        if (rc >= 0) {
+                uint8_t deleted = FAT_DELETED_ENTRY;
+                rc = fat16_write_bytes(disk, dentry.entry_pos, 1, (const char *)&deleted);
+        }
+        if (rc >= 0 && dentry.long_name_entries)
+                rc = fat16_delete_long_name(disk, &dentry);
+
+        /* The deleted entry stays in the directory's name index.  Lookups check the name of every candidate they read back, so they skip it.
+         * An entry with a long name may be cached under both of its names.
+         */
+        if (dentry.long_name_entries)
+                dcache_invalidate_directory(disk, parent);
+        dcache_insert(disk, parent, name, 0, 0);
+
+        int flush_rc = fat16_flush_fat(disk);
+        if (rc < 0 || (rc = flush_rc) < 0)
+                return rc;
+
+        return disk_sync(disk);
+}
+
 /* fat16_fseek - reposition the file stream
  *
  * Sets the file position indicator for the file associated with private (fs implementation specific data).  
@@ -682,27 +2535,29 @@ size_t fat16_fread(struct disk *disk, void *descriptor, size_t size, size_t nmem
 int fat16_fseek(void *private, size_t offset, enum file_seek_mode whence)
 {
         struct fat_file_descriptor *desc = private;
-        if (desc->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
+        if (desc->file->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
                 return -EINVARG;
         }
-        struct fat_directory_entry *raw_entry = desc->easy_directory_entry->entry;
-        if (offset >= raw_entry->filesize) {
-                return -EIO;
-        }
-
+        struct fat_directory_entry *raw_entry = desc->file->easy_directory_entry->entry;
+        uint64_t pos = 0;
         switch (whence) {
                 case SEEK_SET:
-                        desc->pos = offset;
+                        pos = offset;
                         break;
                 case SEEK_CUR:
-                        desc->pos += offset;
+                        pos = (uint64_t)desc->pos + offset;
                         break;
                 case SEEK_END:
                         return -EUNIMP;
                 default:
                         return -EINVARG;
         }
-        
+
+        /* Seeking to end-of-file is allowed.  Reads from there return 0 items */
+        if (pos > raw_entry->filesize)
+                return -EIO;
+
+        desc->pos = pos;
         return 0;
 }
 
@@ -716,11 +2571,11 @@ int fat16_fseek(void *private, size_t offset, enum file_seek_mode whence)
 int fat16_fstat(struct disk *disk, void *private, struct file_stat *stat)
 {
         struct fat_file_descriptor *desc = private;
-        if (desc->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
+        if (desc->file->easy_directory_entry->type == FAT_ITEM_TYPE_DIRECTORY) {
                 return -EINVARG;
         }
 
-        struct fat_directory_entry *raw_entry = desc->easy_directory_entry->entry;
+        struct fat_directory_entry *raw_entry = desc->file->easy_directory_entry->entry;
         stat->filesize = raw_entry->filesize;
         stat->flags = 0x00;
         if (raw_entry->attribute & FAT_FILE_READ_ONLY) {
@@ -730,19 +2585,124 @@ int fat16_fstat(struct disk *disk, void *private, struct file_stat *stat)
         return 0;
 }
 
-static void fat16_free_file_descriptor(struct fat_file_descriptor *desc)
-{
-        fat16_easy_dir_entry_free(desc->easy_directory_entry);
-        kfree(desc);
-}
-
 /* fat16_fclose - close a stream
  *
- * Closes the file associated with the file descriptor fd.
- * Returns 0 on success or < 0 on failure.
+ * Closes the file associated with the file descriptor fd.  If the descriptor wrote to the file, the disk is synced
+ * so that the file's data and metadata are on the disk once it's closed.
+ * Returns 0 on success or < 0 on failure (the descriptor is closed either way).
  */
 int fat16_fclose(void *private)
 {
-        fat16_free_file_descriptor((struct fat_file_descriptor *) private);
+        struct fat_file_descriptor *desc = private;
+        struct disk *disk = desc->vnode->disk;
+        bool written = desc->written;
+        fat16_free_file_descriptor(desc);
+        return written ? disk_sync(disk) : 0;
+}
+
+/* Opens the file of private (a fat_file_descriptor instance) again for reading, sharing its vnode.
+ * Returns the new fat_file_descriptor instance, positioned at the start of the file, or < 0 on failure
+ */
+void *fat16_fdup(struct disk *disk, void *private)
+{
+        struct fat_file_descriptor *desc = private;
+        struct fat_file_descriptor *dup = kzalloc(sizeof(struct fat_file_descriptor));
+        if (!dup)
+                return ERROR(-ENOMEM);
+
+        dup->vnode = vnode_get(disk, desc->vnode->id);
+        dup->file = desc->file;
+        dup->pos = 0;
+        dup->mode = READ;
+        return dup;
+}
+
+/* Returns the vnode of private (a fat_file_descriptor instance) */
+struct vnode *fat16_vnode(void *private)
+{
+        return ((struct fat_file_descriptor *)private)->vnode;
+}
+
+/* Opens a directory stream on the directory at path on disk (the root directory if path is 0).
+ * Returns a fat_directory_stream instance on success, or < 0 on failure
+ */
+void *fat16_opendir(struct disk *disk, struct path_part *path)
+{
+        uint32_t cluster = 0;
+        if (path) {
+                uint32_t parent = 0;
+                const char *name = 0;
+                struct fat_dentry dentry;
+                int rc = fat16_lookup_parent(disk, path, &parent, &name);
+                if (rc < 0)
+                        return ERROR(rc);
+
+                rc = fat16_lookup(disk, parent, name, &dentry);
+                if (rc < 0)
+                        return ERROR(rc);
+                if (rc == 0)
+                        return ERROR(-EIO);
+
+                if (!(dentry.entry.attribute & FAT_FILE_SUBDIRECTORY))
+                        return ERROR(-EBADPATH);
+
+                /* A ".." entry that refers to the root directory has a first cluster of 0 */
+                cluster = fat16_get_first_cluster(&dentry.entry);
+        }
+
+        struct fat_directory_stream *stream = kzalloc(sizeof(struct fat_directory_stream));
+        if (!stream)
+                return ERROR(-ENOMEM);
+
+        fat16_directory_iterator_init(disk, cluster, &stream->it);
+        return stream;
+}
+
+/* Reads up to max named entries of the directory stream private (a fat_directory_stream instance) to entries.
+ * Each entry is reported by its long file name if it has one that fits in a dirent, and by its 8.3 name otherwise.
+ * Free entries and volume labels are skipped.  The stream stops right after the last entry that's returned,
+ * so the next call picks up from there without rereading anything.
+ * Returns the # of entries read (0 at the end of the directory) or < 0 on failure
+ */
+int fat16_readdir(struct disk *disk, void *private, struct dirent *entries, int max)
+{
+        struct fat_directory_stream *stream = private;
+        struct fat_directory_entry raw_entry;
+        int total = 0;
+        int rc = 0;
+        while (total < max && (rc = fat16_directory_iterator_next(&stream->it, &raw_entry)) > 0) {
+                if (!fat16_is_named_entry(&raw_entry)) {
+                        fat16_long_name_decode(&stream->decoder, &raw_entry);
+                        continue;
+                }
+
+                struct dirent *dirent = &entries[total++];
+                int long_name_entries = fat16_long_name_complete(&stream->decoder, &raw_entry);
+                int length = long_name_entries ? fat16_long_name_to_utf8(&stream->decoder, long_name_entries, stream->long_name) : 0;
+                if (length > 0 && length < DIRENT_NAME_MAX)
+                        strncpy(dirent->name, stream->long_name, DIRENT_NAME_MAX);
+                else
+                        fat16_get_filename(&raw_entry, dirent->name, DIRENT_NAME_MAX);
+
+                if (raw_entry.attribute & FAT_FILE_SUBDIRECTORY) {
+                        dirent->type = DIRENT_TYPE_DIRECTORY;
+                        dirent->filesize = 0;
+                } else {
+                        dirent->type = DIRENT_TYPE_FILE;
+                        dirent->filesize = raw_entry.filesize;
+                }
+        }
+
+        /* Entries read before a failure are returned.  The failure is reported by the next call, which retries the same entry. */
+        if (rc < 0 && total == 0)
+                return rc;
+
+        return total;
+}
+
+/* Closes the directory stream private (a fat_directory_stream instance) */
+int fat16_closedir(void *private)
+{
+        kfree(private);
         return 0;
-}
\ No newline at end of file
+}
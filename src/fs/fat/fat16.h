@@ -3,19 +3,29 @@
 
 #include "fs/file.h"
 
-/* Our FAT16 filesystem implementation is only going to support reading from files!  At least, for now. */
+/* Our FAT16 filesystem implementation supports reading, writing, creating and deleting files, and listing directories.  Directories can't be created or deleted yet.
+ * FAT32 volumes are handled by the same driver, registered as a separate filesystem (see fat32_init).
+ */
 
 /* Initializes the fat16 filesystem and returns a pointer to it's implementation */
 struct filesystem *fat16_init();
 
+/* Initializes the fat32 filesystem and returns a pointer to it's implementation */
+struct filesystem *fat32_init();
+
 /* fat16_resolve
 * Reads boot sector of disk and returns 0 if disk is formatted to FAT16 or < 0 otherwise
 */
 int fat16_resolve(struct disk *disk);
 
-/* Creates a file descriptor corresponding to the file at path on disk 
- * Right now this filesystem implementation only supports file reads, so the only
- * allowed mode is READ.
+/* fat32_resolve
+* Reads boot sector of disk and returns 0 if disk is formatted to FAT32 or < 0 otherwise
+*/
+int fat32_resolve(struct disk *disk);
+
+/* Creates a file descriptor corresponding to the file at path on disk.
+ * READ opens an existing file or directory.  WRITE and APPEND only open files, creating them if they don't exist,
+ * and WRITE truncates the file to 0 bytes.
  * Returns an initialized fat_file_descriptor instance on success, or < 0 on failure
  */
 void *fat16_fopen(struct disk *disk, struct path_part *path, enum file_mode mode);
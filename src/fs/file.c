@@ -5,10 +5,14 @@
 #include "memory/heap/kernel_heap.h"
 #include "status.h"
 #include "fs/fat/fat16.h"
+#include "fs/dcache.h"
+#include "fs/vnode.h"
+#include "fs/page_cache.h"
 #include "fs/pparser.h"
 #include "disk/disk.h"
 #include "string/string.h"
 #include "kernel.h"
+#include "memory/paging/paging.h"
 
 /* TODO: should adjust functions to fit linux kernel return value style guidelines.
  * Imperative command functions should return 0 on success or < 0 on failure.
@@ -21,6 +25,10 @@ struct filesystem *filesystems[MAX_FILESYSTEMS];
 /* Array of every open file */
 struct file_descriptor *file_descriptors[MAX_OPEN_FILES];
 
+/* Stack of the indexes of file_descriptors that are free, so that opening and closing a file takes constant time */
+static int free_descriptors[MAX_OPEN_FILES];
+static int total_free_descriptors;
+
 /* Finds an open slot in the filesystems arrays (space for a new filesystem implementation) and returns a pointer to that slot 
  * Returns 0 if no free filesystem slots are available
  */
@@ -53,36 +61,48 @@ static void fs_static_load()
 {
         memset(filesystems, 0, sizeof(filesystems));
         fs_insert_filesystem(fat16_init());
+        fs_insert_filesystem(fat32_init());
 }
 
 void fs_init()
 {
         memset(file_descriptors, 0, sizeof(file_descriptors));
+
+        /* The lowest indexes are on top */
+        for (int i = 0; i < MAX_OPEN_FILES; i++)
+                free_descriptors[i] = MAX_OPEN_FILES - 1 - i;
+        total_free_descriptors = MAX_OPEN_FILES;
+
+        dcache_init();
+        vnode_init();
+        page_cache_init();
         fs_static_load();
 }
 
 static void free_file_descriptor(struct file_descriptor *desc)
 {
       file_descriptors[desc->index] = 0;
+      free_descriptors[total_free_descriptors++] = desc->index;
       kfree(desc);
 }
 
-/* Searches for an open slot in file_descriptors.  If it finds one, it will
- * allocate a new file descriptor and assign desc_out the address of the pointer to that new file descriptor.
+/* Takes a free slot in file_descriptors off of the free stack, allocates a new file descriptor for it,
+ * and assigns desc_out the address of the pointer to that new file descriptor.
  * Returns 0 on success or -ENOMEM on failure
  */
 static int file_new_descriptor(struct file_descriptor **desc_out)
 {
-        for (int i = 0; i < MAX_OPEN_FILES; i++) {
-                if (!file_descriptors[i]) {
-                        file_descriptors[i] = kzalloc(sizeof(struct file_descriptor));
-                        file_descriptors[i]->index = i;
-                        *desc_out = file_descriptors[i];
-                        return 0;
-                }
+        if (total_free_descriptors == 0)
+                return -ENOMEM;
 
-        }
-        return -ENOMEM;
+        struct file_descriptor *desc = kzalloc(sizeof(struct file_descriptor));
+        if (!desc)
+                return -ENOMEM;
+
+        desc->index = free_descriptors[--total_free_descriptors];
+        file_descriptors[desc->index] = desc;
+        *desc_out = desc;
+        return 0;
 }
 
 /* Searches through the open file descriptors and returns one 
@@ -97,6 +117,16 @@ static struct file_descriptor *file_get_descriptor(int fd)
         return file_descriptors[fd];
 }
 
+/* Returns the open file (not directory stream) whose index is fd, or 0 if there's none */
+static struct file_descriptor *file_get_stream(int fd)
+{
+        struct file_descriptor *desc = file_get_descriptor(fd);
+        if (!desc || desc->directory)
+                return 0;
+
+        return desc;
+}
+
 struct filesystem *fs_resolve(struct disk *disk)
 {
         struct filesystem *fs = 0;
@@ -129,38 +159,57 @@ enum file_mode file_get_mode_by_string(const char *str)
                 return INVALID;
 }
 
-int fopen(const char *filename, const char *mode_str)
+/* Parses filename and finds the disk it's on.  Sets *path_root_out (which the caller must free with pparser_free) and *disk_out.
+ * filename can only be just a root path (e.g. '0:/') if allow_root is true.
+ * Returns 0 on success or < 0 on failure
+ */
+static int file_resolve_path(const char *filename, bool allow_root, struct path_root **path_root_out, struct disk **disk_out)
 {
         struct path_root *path_root = pparser_parse(filename, NULL);
         if (!path_root)
                 return -EINVARG;
 
-        /* We can't have just a root path.  E.g. '0:/'.  We need something like '0:/bin/shell.bin' */
-        if (!path_root->first)
+        /* Files need something like '0:/bin/shell.bin'.  Only directories can be just a root path. */
+        if (!path_root->first && !allow_root) {
+                pparser_free(path_root);
                 return -EINVARG;
+        }
 
-        /* Make sure the disk we are reading from exists */
+        /* Make sure the disk the file is on exists, and that it's formatted to a filesystem that we understand and have a driver implementation for */
         struct disk *disk = disk_get(path_root->drive_no);
-        if (!disk)
+        if (!disk || !disk->filesystem) {
+                pparser_free(path_root);
                 return -EIO;
+        }
 
-        /* Ensure that the disk is formatted to a filesystem that we understand and have a driver implementation for */
-        if (!disk->filesystem)
-                return -EIO;
+        *path_root_out = path_root;
+        *disk_out = disk;
+        return 0;
+}
 
+int fopen(const char *filename, const char *mode_str)
+{
         enum file_mode file_mode = file_get_mode_by_string(mode_str);
         if (file_mode == INVALID)
                 return -EINVARG;
 
+        struct path_root *path_root = 0;
+        struct disk *disk = 0;
+        int rc = file_resolve_path(filename, false, &path_root, &disk);
+        if (rc < 0)
+                return rc;
+
         void *file_priv_data = disk->filesystem->fs_open(disk, path_root->first, file_mode);
+        pparser_free(path_root);
         if (IS_ERROR(file_priv_data))
                 return ERROR_I(file_priv_data);
 
-        int rc = 0;
         struct file_descriptor *file = 0;
         rc = file_new_descriptor(&file);
-        if (rc < 0)
+        if (rc < 0) {
+                disk->filesystem->fs_fclose(file_priv_data);
                 return rc;
+        }
         file->filesystem = disk->filesystem;
         file->private = file_priv_data;
         file->disk = disk;
@@ -172,7 +221,7 @@ size_t fread(void *ptr, size_t size, size_t nmemb, int fd)
         if (size == 0 || nmemb == 0 || fd < 0)
                 return -EINVARG;
 
-        struct file_descriptor *desc = file_get_descriptor(fd);
+        struct file_descriptor *desc = file_get_stream(fd);
         if (!desc)
                 return -EINVARG;
 
@@ -182,7 +231,7 @@ size_t fread(void *ptr, size_t size, size_t nmemb, int fd)
 
 int fseek(int fd, size_t offset, enum file_seek_mode whence)
 {
-        struct file_descriptor *desc = file_get_descriptor(fd);
+        struct file_descriptor *desc = file_get_stream(fd);
         if (!desc)
                 return -EINVARG;
         
@@ -191,7 +240,7 @@ int fseek(int fd, size_t offset, enum file_seek_mode whence)
 
 int fstat(int fd, struct file_stat *stat)
 {
-        struct file_descriptor *desc = file_get_descriptor(fd);
+        struct file_descriptor *desc = file_get_stream(fd);
         if (!desc)
                 return -EINVARG;
 
@@ -204,7 +253,262 @@ int fclose(int fd)
         if (!desc)
                 return -EINVARG;
 
-        desc->filesystem->fs_fclose(desc->private);
+        /* The descriptor is gone even if the filesystem couldn't write back what it changed */
+        int rc = 0;
+        if (desc->directory)
+                desc->filesystem->fs_closedir(desc->private);
+        else
+                rc = desc->filesystem->fs_fclose(desc->private);
         free_file_descriptor(desc);
+        return rc;
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, int fd)
+{
+        if (size == 0 || nmemb == 0 || fd < 0)
+                return -EINVARG;
+
+        struct file_descriptor *desc = file_get_stream(fd);
+        if (!desc)
+                return -EINVARG;
+
+        if (!desc->filesystem->fs_fwrite)
+                return -ERDONLY;
+
+        return desc->filesystem->fs_fwrite(desc->disk, desc->private, size, nmemb, (const char *)ptr);
+}
+
+int ftruncate(int fd, size_t length)
+{
+        struct file_descriptor *desc = file_get_stream(fd);
+        if (!desc)
+                return -EINVARG;
+
+        if (!desc->filesystem->fs_ftruncate)
+                return -ERDONLY;
+
+        return desc->filesystem->fs_ftruncate(desc->disk, desc->private, length);
+}
+
+int fcreate(const char *filename)
+{
+        struct path_root *path_root = 0;
+        struct disk *disk = 0;
+        int rc = file_resolve_path(filename, false, &path_root, &disk);
+        if (rc < 0)
+                return rc;
+
+        rc = disk->filesystem->fs_create ? disk->filesystem->fs_create(disk, path_root->first) : -ERDONLY;
+        pparser_free(path_root);
+        return rc;
+}
+
+int unlink(const char *filename)
+{
+        struct path_root *path_root = 0;
+        struct disk *disk = 0;
+        int rc = file_resolve_path(filename, false, &path_root, &disk);
+        if (rc < 0)
+                return rc;
+
+        rc = disk->filesystem->fs_unlink ? disk->filesystem->fs_unlink(disk, path_root->first) : -ERDONLY;
+        pparser_free(path_root);
+        return rc;
+}
+
+int opendir(const char *dirname)
+{
+        struct path_root *path_root = 0;
+        struct disk *disk = 0;
+        int rc = file_resolve_path(dirname, true, &path_root, &disk);
+        if (rc < 0)
+                return rc;
+
+        if (!disk->filesystem->fs_opendir) {
+                pparser_free(path_root);
+                return -EUNIMP;
+        }
+
+        void *dir_priv_data = disk->filesystem->fs_opendir(disk, path_root->first);
+        pparser_free(path_root);
+        if (IS_ERROR(dir_priv_data))
+                return ERROR_I(dir_priv_data);
+
+        struct file_descriptor *dir = 0;
+        rc = file_new_descriptor(&dir);
+        if (rc < 0) {
+                disk->filesystem->fs_closedir(dir_priv_data);
+                return rc;
+        }
+        dir->filesystem = disk->filesystem;
+        dir->private = dir_priv_data;
+        dir->disk = disk;
+        dir->directory = true;
+        return dir->index;
+}
+
+int readdir(int fd, struct dirent *entries, int max)
+{
+        if (max <= 0)
+                return -EINVARG;
+
+        struct file_descriptor *desc = file_get_descriptor(fd);
+        if (!desc || !desc->directory)
+                return -EINVARG;
+
+        return desc->filesystem->fs_readdir(desc->disk, desc->private, entries, max);
+}
+
+/* Returns the vnode of the open file desc, or 0 if its filesystem doesn't have vnodes (so its files can't be memory mapped) */
+static struct vnode *file_get_vnode(struct file_descriptor *desc)
+{
+        if (!desc->filesystem->fs_vnode || !desc->filesystem->fs_dup)
+                return 0;
+
+        return desc->filesystem->fs_vnode(desc->private);
+}
+
+int fmap(int fd)
+{
+        struct file_descriptor *desc = file_get_stream(fd);
+        if (!desc)
+                return -EINVARG;
+
+        if (!file_get_vnode(desc))
+                return -EUNIMP;
+
+        /* Only files (not directories) can be mapped */
+        struct file_stat stat;
+        int rc = fstat(fd, &stat);
+        if (rc < 0)
+                return rc;
+
+        void *map_priv_data = desc->filesystem->fs_dup(desc->disk, desc->private);
+        if (IS_ERROR(map_priv_data))
+                return ERROR_I(map_priv_data);
+
+        struct file_descriptor *map = 0;
+        rc = file_new_descriptor(&map);
+        if (rc < 0) {
+                desc->filesystem->fs_fclose(map_priv_data);
+                return rc;
+        }
+        map->filesystem = desc->filesystem;
+        map->private = map_priv_data;
+        map->disk = desc->disk;
+
+        file_get_vnode(map)->mappings++;
+        return map->index;
+}
+
+int fmap_page(int fd, uint32_t index, void **page_out)
+{
+        struct file_descriptor *desc = file_get_stream(fd);
+        if (!desc)
+                return -EINVARG;
+
+        struct vnode *vnode = file_get_vnode(desc);
+        if (!vnode || vnode->mappings == 0)
+                return -EINVARG;
+
+        void *page = page_cache_lookup(vnode, index);
+        if (page) {
+                *page_out = page;
+                return 0;
+        }
+
+        struct file_stat stat;
+        int rc = fstat(fd, &stat);
+        if (rc < 0)
+                return rc;
+
+        /* Only pages that hold part of the file are cached.  Anything past them is up to the mapper (e.g. its own zero pages). */
+        uint32_t file_pages = stat.filesize / PAGING_PAGE_SIZE + (stat.filesize % PAGING_PAGE_SIZE != 0);
+        if (index >= file_pages)
+                return -EINVARG;
+
+        /* Heap blocks are page sized and aligned, so the page can be mapped as is */
+        page = kzalloc(PAGING_PAGE_SIZE);
+        if (!page)
+                return -ENOMEM;
+
+        uint32_t offset = index * PAGING_PAGE_SIZE;
+        uint32_t size = stat.filesize - offset < PAGING_PAGE_SIZE ? stat.filesize - offset : PAGING_PAGE_SIZE;
+        rc = fseek(fd, offset, SEEK_SET);
+        if (rc == 0 && fread(page, size, 1, fd) != 1)
+                rc = -EIO;
+
+        if (rc == 0)
+                rc = page_cache_insert(vnode, index, page);
+        if (rc < 0) {
+                kfree(page);
+                return rc;
+        }
+
+        *page_out = page;
         return 0;
-}
\ No newline at end of file
+}
+
+int funmap(int fd)
+{
+        struct file_descriptor *desc = file_get_stream(fd);
+        if (!desc)
+                return -EINVARG;
+
+        struct vnode *vnode = file_get_vnode(desc);
+        if (!vnode || vnode->mappings == 0)
+                return -EINVARG;
+
+        /* None of the pages can be mapped anywhere anymore */
+        if (--vnode->mappings == 0)
+                page_cache_drop(vnode);
+
+        return fclose(fd);
+}
+
+void file_table_init(struct file_table *table)
+{
+        memset(table, 0, sizeof(struct file_table));
+}
+
+int file_table_install(struct file_table *table, int file)
+{
+        /* Find the first descriptor that isn't in use, a word of the bitmap at a time */
+        for (int i = 0; i < PROCESS_MAX_OPEN_FILES / 32; i++) {
+                if (table->used[i] == 0xFFFFFFFF)
+                        continue;
+
+                int fd = i * 32 + __builtin_ctz(~table->used[i]);
+                table->used[i] |= 1u << (fd & 31);
+                table->files[fd] = file;
+                return fd;
+        }
+
+        return -ENOMEM;
+}
+
+int file_table_get(struct file_table *table, int fd)
+{
+        if (fd < 0 || fd >= PROCESS_MAX_OPEN_FILES || !(table->used[fd >> 5] & (1u << (fd & 31))))
+                return -EINVARG;
+
+        return table->files[fd];
+}
+
+int file_table_close(struct file_table *table, int fd)
+{
+        int file = file_table_get(table, fd);
+        if (file < 0)
+                return file;
+
+        table->used[fd >> 5] &= ~(1u << (fd & 31));
+        return fclose(file);
+}
+
+void file_table_close_all(struct file_table *table)
+{
+        for (int fd = 0; fd < PROCESS_MAX_OPEN_FILES; fd++) {
+                if (table->used[fd >> 5] & (1u << (fd & 31)))
+                        file_table_close(table, fd);
+        }
+}
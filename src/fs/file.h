@@ -5,14 +5,18 @@
  * 
  * We have significantly fewer levels of abstraction in our vfs than the Linux kernel 
  * (i.e. no dentry, inode, etc...)
+ * The closest things are the dcache (dcache.h), which remembers name lookups, and vnodes (vnode.h),
+ * which filesystems use to share the state of a file between every descriptor open on it.
  */
 
 #ifndef FILE_H
 #define FILE_H
 
 #include "fs/pparser.h"
+#include "config.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define FS_NAME_MAX     20
 
@@ -29,6 +33,19 @@ enum file_mode {
         INVALID         //??
 };
 
+/* Types of directory entries */
+#define DIRENT_TYPE_FILE        0
+#define DIRENT_TYPE_DIRECTORY   1
+
+#define DIRENT_NAME_MAX         256                             // Including the null terminator
+
+/* An entry of a directory, as returned by readdir.  Entries have a fixed size so that a batch of them is just an array. */
+struct dirent {
+        uint32_t filesize;                                      // 0 for a directory
+        uint32_t type;                                          // DIRENT_TYPE_FILE or DIRENT_TYPE_DIRECTORY
+        char name[DIRENT_NAME_MAX];
+};
+
 /* File stat flags (bitmasks) */
 #define FILE_STAT_READ_ONLY 0b00000001
 
@@ -39,6 +56,7 @@ struct file_stat {
 
 /* We need to forward declare disk since disk.h includes this file */
 struct disk;            
+struct vnode;
 
 /* Each concrete file system driver implementation in our OS will have an associated filesystem struct instance */
 struct filesystem {
@@ -49,6 +67,7 @@ struct filesystem {
          *
          * Opens the file whose path is the value contained in list beginning with path_part and associates
          * a stream with it.  This will return filesystem implementation specific private data.
+         * WRITE and APPEND create the file if it doesn't exist, and WRITE truncates it to 0 bytes.
          */
         void *(*fs_open)(struct disk *disk, struct path_part *path_part, enum file_mode mode);
 
@@ -105,6 +124,75 @@ struct filesystem {
          * Returns 0 on success or < 0 on failure.
          */
         int (*fs_fclose)(void *private);
+
+        /* fs_fwrite - binary stream output
+         *
+         * Writes nmemb items of data, each size bytes long, from in
+         * to the stream associated with private (fs implementation specific data), growing the file as needed.
+         * The stream must have been opened with WRITE or APPEND.
+         *
+         * Returns nmemb on success or < 0 on failure.
+         */
+        size_t (*fs_fwrite)(struct disk *disk, void *private, size_t size, size_t nmemb, const char *in);
+
+        /* fs_ftruncate - set the size of a file
+         *
+         * Shrinks or grows the file associated with private (fs implementation specific data) to length bytes.
+         * Bytes added to the file read back as zeros.
+         *
+         * Returns 0 on success or < 0 on failure.
+         */
+        int (*fs_ftruncate)(struct disk *disk, void *private, size_t length);
+
+        /* fs_create - create an empty file
+         *
+         * Creates an empty file at the path contained in the list beginning with path_part.
+         * Returns 0 on success or < 0 on failure (-EISTAKEN if the path already exists).
+         */
+        int (*fs_create)(struct disk *disk, struct path_part *path_part);
+
+        /* fs_unlink - delete a file
+         *
+         * Deletes the file at the path contained in the list beginning with path_part.
+         * Returns 0 on success or < 0 on failure (-EBUSY if the file is open).
+         */
+        int (*fs_unlink)(struct disk *disk, struct path_part *path_part);
+
+        /* fs_opendir - open a directory stream
+         *
+         * Opens the directory whose path is the value contained in the list beginning with path_part (the root directory if path_part is 0),
+         * positioned at its first entry.  This will return filesystem implementation specific private data, or < 0 on failure.
+         */
+        void *(*fs_opendir)(struct disk *disk, struct path_part *path_part);
+
+        /* fs_readdir - read a batch of directory entries
+         *
+         * Reads up to max entries from the directory stream associated with private (fs implementation specific data) to entries,
+         * and advances the stream past them.
+         * Returns the # of entries read (0 at the end of the directory) or < 0 on failure.
+         */
+        int (*fs_readdir)(struct disk *disk, void *private, struct dirent *entries, int max);
+
+        /* fs_closedir - close a directory stream
+         *
+         * Closes the directory stream associated with private (fs implementation specific data).
+         * Returns 0 on success or < 0 on failure.
+         */
+        int (*fs_closedir)(void *private);
+
+        /* fs_dup - open a file again
+         *
+         * Returns new private data (fs implementation specific data) for the file associated with private, opened for reading
+         * with its own file position at the start of the file, or < 0 on failure.
+         */
+        void *(*fs_dup)(struct disk *disk, void *private);
+
+        /* fs_vnode - get the vnode of an open file
+         *
+         * Returns the vnode (vnode.h) of the file associated with private (fs implementation specific data).
+         * Filesystems that implement fs_vnode must refuse to write or truncate files that are memory mapped (vnode->mappings > 0).
+         */
+        struct vnode *(*fs_vnode)(void *private);
 };
 
 /* File descriptor that represents an open file */
@@ -121,6 +209,9 @@ struct file_descriptor {
 
         struct disk *disk;
 
+        /* True if this is a directory stream opened by opendir.  Directory streams can only be used with readdir and fclose. */
+        bool directory;
+
         /* private will point to driver implementation specific data
          * which will be used by other functions for finding the file on disk.
          * This field will be set by fs_open.
@@ -128,6 +219,16 @@ struct file_descriptor {
         void *private;
 };
 
+/* A process's table of file descriptors.
+ * The file descriptors of a process are small integers that are handed out lowest first, like in Unix.  Each one refers to an
+ * open file: an index into the kernel's table of every open file, as returned by fopen.  Since every process has its own table,
+ * a process can have PROCESS_MAX_OPEN_FILES files open no matter how many files other processes have open.
+ */
+struct file_table {
+        int files[PROCESS_MAX_OPEN_FILES];                      // The open file that each descriptor refers to
+        uint32_t used[PROCESS_MAX_OPEN_FILES / 32];             // Bit n is set if descriptor n is in use
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /* Our VFS layer functions */
 
@@ -146,6 +247,7 @@ void fs_insert_filesystem(struct filesystem *filesystem);
  * 
  * mode_str - string that specifies the mode the file should be opened in
  *               'r' = read, 'w' = write, 'a' = append
+ *            'w' and 'a' create the file if it doesn't exist.  'w' truncates it to 0 bytes.
  * filename - absolute path to the file
  * 
  * Returns the file descriptor index associated with filename (non-negative integer) on success
@@ -165,13 +267,12 @@ struct filesystem *fs_resolve(struct disk *disk);
  *
  * Reads nmemb items of data, each size bytes long, 
  * from the file stream associated with the file descriptor fd.
- * Stores the read data at the location given by ptr.
+ * Stores the read data at the location given by ptr, and advances the file position past the items read.
  * This function can only be called on a file, not a directory.
  * 
  * 
  * Returns the count of size elements that were read.
- * This may not always equal nmemb since an error or end-of-file may occur after some
- * elements have already been read.
+ * This may not always equal nmemb since end-of-file may come before all of them.
  * Therefore, to check for failure, look for a short item count return value (or < 0)
  */
 size_t fread(void *ptr, size_t size, size_t nmemb, int fd);
@@ -201,9 +302,112 @@ int fstat(int fd, struct file_stat *stat);
 
 /* fclose - close a stream
  *
- * Closes the file associated with the file descriptor fd.
- * Returns 0 on success or < 0 on failure.
+ * Closes the file (or directory stream) associated with the file descriptor fd.  Closing a descriptor that wrote to its file
+ * writes the file's changes back to the disk.
+ * Returns 0 on success or < 0 on failure.  fd is closed even if writing back fails.
  */
 int fclose(int fd);
 
-#endif
\ No newline at end of file
+/* fwrite - binary stream output
+ *
+ * Writes nmemb items of data, each size bytes long, from ptr
+ * to the file stream associated with the file descriptor fd, and advances the file position past the items written.
+ * The file must have been opened with 'w' or 'a'.  With 'a', every write goes to end-of-file.
+ *
+ * Returns nmemb on success or < 0 on failure.
+ */
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, int fd);
+
+/* ftruncate - set the size of a file
+ *
+ * Shrinks or grows the file associated with the file descriptor fd to length bytes.
+ * Bytes added to the file read back as zeros.
+ *
+ * Returns 0 on success or < 0 on failure.
+ */
+int ftruncate(int fd, size_t length);
+
+/* fcreate - create an empty file
+ *
+ * filename - absolute path to the file
+ *
+ * Returns 0 on success or < 0 on failure (-EISTAKEN if filename already exists).
+ */
+int fcreate(const char *filename);
+
+/* unlink - delete a file
+ *
+ * filename - absolute path to the file.  Directories can't be deleted.
+ *
+ * Returns 0 on success or < 0 on failure (-EBUSY if the file is open).
+ */
+int unlink(const char *filename);
+
+/* opendir - open a directory stream
+ *
+ * dirname - absolute path to the directory.  E.g. '0:/bin' or '0:/' for the root directory.
+ *
+ * Returns the file descriptor index of the directory stream (non-negative integer) on success, or < 0 on failure.
+ * The stream is closed with fclose.
+ */
+int opendir(const char *dirname);
+
+/* readdir - read a batch of directory entries
+ *
+ * Reads up to max entries of the directory stream associated with the file descriptor fd to entries,
+ * and advances the stream past them.  Free entries and volume labels are skipped.
+ * A whole directory can be listed by calling readdir until it returns 0.
+ *
+ * Returns the # of entries read (0 at the end of the directory) or < 0 on failure.
+ */
+int readdir(int fd, struct dirent *entries, int max);
+
+/* fmap - start a memory mapping of a file
+ *
+ * Opens the file associated with the file descriptor fd again (for reading), for a memory mapping to read the file's pages
+ * through with fmap_page, and counts the mapping against the file.  While a file is mapped, its pages are kept in the page cache
+ * and it can't be written or truncated (-EBUSY).
+ *
+ * Returns the file descriptor index of the mapping's open file (non-negative integer) on success, or < 0 on failure.
+ * The mapping ends with funmap.
+ */
+int fmap(int fd);
+
+/* fmap_page - get a page of a memory mapped file
+ *
+ * Sets *page_out to page index (the PAGING_PAGE_SIZE bytes at offset index * PAGING_PAGE_SIZE) of the file
+ * associated with the file descriptor fd (e.g. returned by fmap), which must be mapped, reading it into the page cache if it isn't there already.
+ * The bytes of the last page past end-of-file are zeros, and pages wholly past end-of-file can't be mapped (-EINVARG).
+ * The page is page aligned and owned by the page cache: it can be mapped into address spaces until the file's last mapping ends.
+ * Moves fd's file position.
+ *
+ * Returns 0 on success or < 0 on failure.
+ */
+int fmap_page(int fd, uint32_t index, void **page_out);
+
+/* funmap - end a memory mapping of a file
+ *
+ * Closes the file descriptor fd (returned by fmap).  The file's pages leave the page cache with its last mapping.
+ * Returns 0 on success or < 0 on failure.
+ */
+int funmap(int fd);
+
+/* Empties table */
+void file_table_init(struct file_table *table);
+
+/* Adds a descriptor that refers to file (an open file returned by fopen) to table.  The table then owns file:
+ * it's closed when the descriptor is.
+ * Returns the lowest descriptor that was free, or -ENOMEM if every descriptor is in use
+ */
+int file_table_install(struct file_table *table, int file);
+
+/* Returns the open file (to pass to fread, fstat, etc...) that descriptor fd of table refers to, or -EINVARG if fd isn't in use */
+int file_table_get(struct file_table *table, int fd);
+
+/* Closes descriptor fd of table, and the open file it refers to.  Returns 0 on success or < 0 on failure */
+int file_table_close(struct file_table *table, int fd);
+
+/* Closes every descriptor of table */
+void file_table_close_all(struct file_table *table);
+
+#endif
@@ -0,0 +1,68 @@
+#include "page_cache.h"
+#include "memory/memory.h"
+#include "memory/heap/kernel_heap.h"
+#include "status.h"
+#include "config.h"
+
+static struct cached_page *hash_buckets[PAGE_CACHE_HASH_BUCKETS];
+
+/* PAGE_CACHE_HASH_BUCKETS must be a power of two */
+static struct cached_page **page_cache_bucket(struct vnode *vnode, uint32_t index)
+{
+        uint32_t hash = ((uint32_t)vnode >> 4) * 31 + index;
+        hash ^= hash >> 13;
+        return &hash_buckets[hash & (PAGE_CACHE_HASH_BUCKETS - 1)];
+}
+
+void page_cache_init()
+{
+        memset(hash_buckets, 0, sizeof(hash_buckets));
+}
+
+void *page_cache_lookup(struct vnode *vnode, uint32_t index)
+{
+        for (struct cached_page *page = *page_cache_bucket(vnode, index); page; page = page->hash_next) {
+                if (page->vnode == vnode && page->index == index)
+                        return page->data;
+        }
+
+        return 0;
+}
+
+int page_cache_insert(struct vnode *vnode, uint32_t index, void *data)
+{
+        struct cached_page *page = kzalloc(sizeof(struct cached_page));
+        if (!page)
+                return -ENOMEM;
+
+        page->vnode = vnode;
+        page->index = index;
+        page->data = data;
+
+        struct cached_page **bucket = page_cache_bucket(vnode, index);
+        page->hash_next = *bucket;
+        *bucket = page;
+
+        page->vnode_next = vnode->pages;
+        vnode->pages = page;
+        return 0;
+}
+
+void page_cache_drop(struct vnode *vnode)
+{
+        struct cached_page *page = vnode->pages;
+        while (page) {
+                struct cached_page *next = page->vnode_next;
+
+                struct cached_page **link = page_cache_bucket(vnode, page->index);
+                while (*link != page)
+                        link = &(*link)->hash_next;
+                *link = page->hash_next;
+
+                kfree(page->data);
+                kfree(page);
+                page = next;
+        }
+
+        vnode->pages = 0;
+}
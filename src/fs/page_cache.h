@@ -0,0 +1,42 @@
+/* page_cache.h
+ *
+ * Page cache.
+ * Holds the pages of files that are memory mapped (see fmap), keyed by (vnode, page index).  Every address space that maps
+ * a file is given the same physical pages, so a file that's mapped many times (e.g. a program that's running more than once)
+ * is only read and kept in memory once.
+ *
+ * Pages are page aligned PAGING_PAGE_SIZE allocations, so they can be mapped straight into page tables.  Since there's no way
+ * to find the page tables a page is mapped into, a file's pages stay cached until its last mapping ends.
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "fs/vnode.h"
+#include <stdint.h>
+
+struct cached_page {
+        struct vnode *vnode;
+        uint32_t index;                                         // Page index within the file
+        void *data;
+
+        struct cached_page *hash_next;                          // Next page in the same hash bucket
+        struct cached_page *vnode_next;                         // Next page of the same file
+};
+
+/* Initialize (or reset) the page cache */
+void page_cache_init();
+
+/* Returns page index of vnode's file, or 0 if it isn't cached */
+void *page_cache_lookup(struct vnode *vnode, uint32_t index);
+
+/* Caches data (a page aligned allocation of PAGING_PAGE_SIZE bytes) as page index of vnode's file, which mustn't already be cached.
+ * The cache owns data from then on.
+ * Returns 0 on success or -ENOMEM on failure (data is then still the caller's)
+ */
+int page_cache_insert(struct vnode *vnode, uint32_t index, void *data);
+
+/* Frees every cached page of vnode's file.  None of them may still be mapped anywhere. */
+void page_cache_drop(struct vnode *vnode);
+
+#endif
@@ -121,8 +121,9 @@ struct path_root *pparser_parse(const char *path, const char *current_dir_path)
         if (!(path_root = pparser_create_root(drive_no)))
                 return 0;
 
+        /* Just the root directory.  E.g. '0:/' */
         if (!(first_part = parse_path_part(NULL, &tmp_path)))
-                return 0;
+                return path_root;
 
         path_root->first = first_part;
 
@@ -18,6 +18,7 @@ struct path_part {                      // TODO: better name?
 /* Parses the file path and returns the complete corresponding path_root struct 
  * Accepts current_dir_path as a parameter so that it can understand relative paths (not implemented yet though)
  * Returns 0 on failure
+ * A path that is just the root directory (e.g. '0:/') has no path parts.  I.e. first is 0.
  * 
  * current_dir_path functionality is not working yet
  */
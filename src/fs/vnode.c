@@ -0,0 +1,62 @@
+#include "vnode.h"
+#include "memory/memory.h"
+#include "memory/heap/kernel_heap.h"
+#include "config.h"
+
+static struct vnode *hash_buckets[VNODE_HASH_BUCKETS];
+
+/* VNODE_HASH_BUCKETS must be a power of two */
+static struct vnode **vnode_bucket(struct disk *disk, uint64_t id)
+{
+        uint32_t hash = (uint32_t)id * 31 ^ (uint32_t)(id >> 32) ^ (disk->id << 16);
+        hash ^= hash >> 13;
+        return &hash_buckets[hash & (VNODE_HASH_BUCKETS - 1)];
+}
+
+void vnode_init()
+{
+        memset(hash_buckets, 0, sizeof(hash_buckets));
+}
+
+struct vnode *vnode_get(struct disk *disk, uint64_t id)
+{
+        for (struct vnode *vnode = *vnode_bucket(disk, id); vnode; vnode = vnode->hash_next) {
+                if (vnode->disk == disk && vnode->id == id) {
+                        vnode->refcount++;
+                        return vnode;
+                }
+        }
+
+        return 0;
+}
+
+struct vnode *vnode_new(struct disk *disk, uint64_t id, void *private)
+{
+        struct vnode *vnode = kzalloc(sizeof(struct vnode));
+        if (!vnode)
+                return 0;
+
+        vnode->disk = disk;
+        vnode->id = id;
+        vnode->refcount = 1;
+        vnode->private = private;
+
+        struct vnode **bucket = vnode_bucket(disk, id);
+        vnode->hash_next = *bucket;
+        *bucket = vnode;
+        return vnode;
+}
+
+bool vnode_put(struct vnode *vnode)
+{
+        if (--vnode->refcount > 0)
+                return false;
+
+        struct vnode **link = vnode_bucket(vnode->disk, vnode->id);
+        while (*link != vnode)
+                link = &(*link)->hash_next;
+        *link = vnode->hash_next;
+
+        kfree(vnode);
+        return true;
+}
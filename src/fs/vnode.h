@@ -0,0 +1,51 @@
+/* vnode.h
+ *
+ * In-memory objects for open files.
+ * A file that's open more than once (e.g. a program binary that's loaded on every exec) gets a single vnode, shared by
+ * every file descriptor open on it, so the filesystem's per-file state (metadata, cluster maps, etc.) is only built once.
+ * Vnodes are keyed by (disk, id), where id is a filesystem specific number that identifies the file on its disk
+ * (e.g. where its directory entry is).
+ *
+ * A vnode lives as long as something holds a reference to it.  The filesystem owns the private data hanging off of it,
+ * and releases that data when it drops the last reference.
+ */
+
+#ifndef VNODE_H
+#define VNODE_H
+
+#include "disk/disk.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+struct vnode {
+        struct disk *disk;
+        uint64_t id;                                            // Identifies the file on disk
+        int refcount;                                           // # of holders (usually open file descriptors)
+        void *private;                                          // Filesystem specific state shared by every holder
+
+        /* Memory mappings of the file (see fmap).  While a file is mapped, its pages are held by the page cache (page_cache.h)
+         * and may be mapped into any number of address spaces, so filesystems must not let the file be written or truncated.
+         */
+        int mappings;
+        struct cached_page *pages;                              // The file's pages in the page cache
+
+        struct vnode *hash_next;                                // Next vnode in the same hash bucket
+};
+
+/* Initialize (or reset) the vnode table */
+void vnode_init();
+
+/* Returns the vnode of file id on disk with a new reference taken, or 0 if there is none */
+struct vnode *vnode_get(struct disk *disk, uint64_t id);
+
+/* Creates the vnode of file id on disk, holding private, with one reference taken.  There must not already be one.
+ * Returns the vnode, or 0 if there isn't enough memory
+ */
+struct vnode *vnode_new(struct disk *disk, uint64_t id, void *private);
+
+/* Drops a reference to vnode.  If it was the last one, vnode is freed and true is returned:
+ * the caller must then release vnode's private data (which it should read before calling this).
+ */
+bool vnode_put(struct vnode *vnode);
+
+#endif
@@ -2,11 +2,13 @@ section .asm
 
 extern isr80h_handler
 extern interrupt_handler
+extern page_fault_handler
 
 global idt_load
 global enable_interrupts
 global disable_interrupts
 global isr80h_wrapper
+global page_fault_wrapper
 global interrupt_pointer_table
 
 enable_interrupts:
@@ -104,10 +106,42 @@ isr80h_wrapper:
 	; from interrupt frame (which will drop us back into userland)
 	iretd
 
+; We aren't going to use the interrupt macro for page faults (interrupt 14) either, because the processor pushes an error code
+; for them on top of the interrupt frame. It has to be popped off before iret.
+; A fault can come from the kernel while it's on any page tables (e.g. reading a task's stack), so the page directory
+; and data segments that were live are saved here and put back before returning, whoever they belonged to.
+page_fault_wrapper:
+	cli							; clear interrupt flag
+	pop dword[page_fault_error_code]	; Pop the error code so that the stack looks like any other interrupt frame
+	pushad						; push all general purpose registers onto the stack (eax, ecd, edx, ebx, original esp, ebp, esi, and edi)
+	mov eax, esp				; eax = address of the interrupt frame
+	mov ecx, cr3				; save the page directory that was loaded when the fault happened
+	push ecx
+	push ds						; save the data segment registers
+	push es
+	push fs
+	push gs
+	push eax 					; Pass page_fault_handler the address of the interrupt frame, like the interrupt macro does
+	push dword[page_fault_error_code]
+	call page_fault_handler		; Returns once the page is mapped in, so that the faulting instruction can run again
+	add esp, 8					; Remove the two items that we added to the stack.
+	pop gs						; restore the data segment registers
+	pop fs
+	pop es
+	pop ds
+	pop ecx						; restore the page directory
+	mov cr3, ecx
+	popad						; Restore all the general purpose registers
+	sti							; set interrupt flag (allow processor to respond to maskable hardware interrupts)
+	iret						; Return to the instruction that faulted
+
 section .data
 ; This is used to store the return result from isr80h_handler
 tmp_res: dd 0
 
+; This is used to hold the error code of a page fault while page_fault_wrapper saves the registers
+page_fault_error_code: dd 0
+
 ; This macro is used to get the address of an interrupt handler based on it's label.
 ; e.g. if the input is 5, then 'dd int5' gives us the address of the int5 label. 
 ; dd = 4 bytes = size of address on 32 bit architecture (x86)
@@ -6,6 +6,7 @@
 #include "kernel.h"
 #include "task/process.h"
 #include "task/task.h"
+#include "memory/paging/paging.h"
 #include <stdint.h>
 #include "status.h"
 
@@ -40,6 +41,7 @@ static struct idtr_desc idtr;
 
 extern void idt_load(struct idtr_desc  *val);
 extern void isr80h_wrapper();
+extern void page_fault_wrapper();
 
 /* 
  * idt_zero - handler for interrupt 0
@@ -96,6 +98,7 @@ void idt_init()
 	// Overwrite handler for the interrupts which require special handling
 	idt_set(0, idt_zero);
 	idt_set(0x80, isr80h_wrapper);
+	idt_set(14, page_fault_wrapper);
 
 	register_handler_for_exceptions();
 
@@ -137,6 +140,22 @@ void *isr80h_handler(int command_id, struct interrupt_frame *frame)
 	return res;
 }
 
+void page_fault_handler(uint32_t error_code, struct interrupt_frame *frame)
+{
+	swap_kernel_page_tables(); 								// switch to kernel pages
+	struct process *process = get_current_process();
+	if (process && process_handle_page_fault(process, paging_get_fault_address(), error_code) == 0)
+		return;												// page_fault_wrapper puts back the page tables and segments that were live
+
+	// The kernel only reads and writes user memory it has checked first (see copy_from_user_task and copy_to_user_task),
+	// so a fault from kernel mode that couldn't be resolved above is a kernel bug.
+	if (!(error_code & PAGING_FAULT_USER))
+		panic("Page fault in the kernel\n");
+
+	task_current_save_state(frame); 						// save the state of the task that was executing
+	idt_handle_user_process_exception();
+}
+
 // Generic interrupt handler. Calls the appropriate interrupt handler for the interrupt # sent to us from the PIC.
 void interrupt_handler(int interrupt, struct interrupt_frame *frame)
 {
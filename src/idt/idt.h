@@ -60,6 +60,13 @@ void *isr80h_handler(int command, struct interrupt_frame *frame);
  */
 void isr80h_register_command(int command_id, ISR80H_COMMAND command);
 
+/* Handler for page faults (interrupt 14), called by page_fault_wrapper with the fault's error code (see PAGING_FAULT_* in paging.h).
+ * Pages of memory mapped files are only mapped in when they're first touched (see process_handle_page_fault),
+ * in which case this returns and the faulting instruction runs again, on the page tables and segments it faulted on.
+ * Any other page fault in a user process terminates the process, like other exceptions.
+ */
+void page_fault_handler(uint32_t error_code, struct interrupt_frame *frame);
+
 /* Calls the appropriate interrupt handler for the interrupt # sent to us from the PIC.
  * To make an interrupt handler visible to this routine, you must register it via 
  * idt_register_interrupt_handler.
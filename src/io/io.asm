@@ -2,8 +2,10 @@ section .asm
 
 global insb
 global insw
+global insl
 global outb
 global outw
+global outl
 
 insb:
 	push ebp		; preserve caller's frame pointer
@@ -30,6 +32,16 @@ insw:
 	pop ebp			; set ebp to caller's frame pointer value
 	ret
 
+insl:
+	push ebp		; preserve caller's frame pointer
+	mov ebp, esp		; create new frame pointer pointing to current stack top
+
+	mov edx, [ebp+8]	; transfer port # into edx register
+	in eax, dx		; input double word from io port in dx into eax
+
+	pop ebp			; set ebp to caller's frame pointer value
+	ret
+
 
 ; void outb(unsigned short port, unsigned char val)
 outb:
@@ -54,3 +66,13 @@ outw:
 	pop ebp			; set ebp to caller's frame pointer value
 	ret
 
+outl:
+	push ebp		; preserve caller's frame pointer
+	mov ebp, esp		; create new frame pointer pointing to current stack top
+
+	mov eax, [ebp+12]	; get val parameter
+	mov edx, [ebp+8]	; get port parameter
+	out dx, eax		; output double word in eax to io/port address in dx
+
+	pop ebp			; set ebp to caller's frame pointer value
+	ret
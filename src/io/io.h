@@ -7,10 +7,16 @@ unsigned char insb(unsigned short port);
 /* Read one word from the port */
 unsigned short insw(unsigned short port);
 
+/* Read one double word from the port */
+unsigned int insl(unsigned short port);
+
 /* output byte val to port */
 void outb(unsigned short port, unsigned char val);
 
 /* output word val to port */
-void outw(unsigned short port, unsigned char val);
+void outw(unsigned short port, unsigned short val);
+
+/* output double word val to port */
+void outl(unsigned short port, unsigned int val);
 
 #endif
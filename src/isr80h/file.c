@@ -0,0 +1,89 @@
+#include "isr80h/file.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "fs/file.h"
+#include "memory/heap/kernel_heap.h"
+#include "status.h"
+#include "config.h"
+
+void *isr80h_command_8_opendir(struct interrupt_frame *frame)
+{
+    struct task *current_task = get_current_task();
+    void *path_usr_addr = task_get_stack_item(current_task, 0);
+
+    char path[MAX_FILE_PATH_CHARS];
+    int rc = copy_string_from_user_task(current_task, path_usr_addr, path, sizeof(path));
+    if (rc < 0)
+        return (void *)rc;
+
+    int dir = opendir(path);
+    if (dir < 0)
+        return (void *)dir;
+
+    int fd = file_table_install(&get_current_process()->files, dir);
+    if (fd < 0)
+        fclose(dir);
+
+    return (void *)fd;
+}
+
+void *isr80h_command_9_readdir(struct interrupt_frame *frame)
+{
+    struct task *current_task = get_current_task();
+    int max = (int)task_get_stack_item(current_task, 0);
+    void *entries_usr_addr = task_get_stack_item(current_task, 1);
+    int fd = (int)task_get_stack_item(current_task, 2);
+
+    int dir = file_table_get(&get_current_process()->files, fd);
+    if (dir < 0)
+        return (void *)dir;
+
+    if (max <= 0 || !entries_usr_addr)
+        return (void *)-EINVARG;
+    if (max > READDIR_BATCH_MAX)
+        max = READDIR_BATCH_MAX;
+
+    /* readdir moves the stream past the entries it returns, so check the process can take them before reading any */
+    int rc = task_prepare_user_buffer(current_task, entries_usr_addr, max * sizeof(struct dirent));
+    if (rc < 0)
+        return (void *)rc;
+
+    /* The whole batch is read into the kernel and copied out to the process at once */
+    struct dirent *entries = kzalloc(max * sizeof(struct dirent));
+    if (!entries)
+        return (void *)-ENOMEM;
+
+    rc = readdir(dir, entries, max);
+    if (rc > 0 && copy_to_user_task(current_task, entries_usr_addr, entries, rc * sizeof(struct dirent)) < 0)
+        rc = -EINVARG;
+
+    kfree(entries);
+    return (void *)rc;
+}
+
+void *isr80h_command_10_close(struct interrupt_frame *frame)
+{
+    int fd = (int)task_get_stack_item(get_current_task(), 0);
+    return (void *)file_table_close(&get_current_process()->files, fd);
+}
+
+void *isr80h_command_11_open(struct interrupt_frame *frame)
+{
+    struct task *current_task = get_current_task();
+    void *path_usr_addr = task_get_stack_item(current_task, 0);
+
+    char path[MAX_FILE_PATH_CHARS];
+    int rc = copy_string_from_user_task(current_task, path_usr_addr, path, sizeof(path));
+    if (rc < 0)
+        return (void *)rc;
+
+    int file = fopen(path, "r");
+    if (file < 0)
+        return (void *)file;
+
+    int fd = file_table_install(&get_current_process()->files, file);
+    if (fd < 0)
+        fclose(file);
+
+    return (void *)fd;
+}
@@ -0,0 +1,26 @@
+#ifndef ISR80H_FILE_H
+#define ISR80H_FILE_H
+
+#include "idt/idt.h"
+
+/* File Kernel Commands.
+ * These work with the current process's file descriptors (see struct file_table).
+ */
+
+// opendir - open a directory stream.  Accepts the absolute path of a directory, e.g. "0:/" or "0:/bin".
+// Returns a file descriptor of the calling process for the directory stream, or < 0 on failure.
+void *isr80h_command_8_opendir(struct interrupt_frame *frame);
+
+// readdir - read a batch of directory entries.  Accepts a directory stream's file descriptor, a user buffer and the
+// # of struct dirent that fit in the buffer.  Fills the buffer with up to READDIR_BATCH_MAX entries in one call.
+// Returns the # of entries read (0 at the end of the directory), or < 0 on failure.
+void *isr80h_command_9_readdir(struct interrupt_frame *frame);
+
+// close - close a file descriptor of the calling process.  Returns 0 on success or < 0 on failure.
+void *isr80h_command_10_close(struct interrupt_frame *frame);
+
+// open - open a file for reading (e.g. to map it with mmap).  Accepts the absolute path of a file.
+// Returns a file descriptor of the calling process for the file, or < 0 on failure.
+void *isr80h_command_11_open(struct interrupt_frame *frame);
+
+#endif
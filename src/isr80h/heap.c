@@ -1,6 +1,8 @@
 #include "heap.h"
 #include "task/task.h"
 #include "task/process.h"
+#include "fs/file.h"
+#include "status.h"
 #include <stddef.h>
 
 void *isr80h_command_4_malloc(struct interrupt_frame *frame)
@@ -15,3 +17,33 @@ void *isr80h_command_5_free(struct interrupt_frame *frame)
     process_free_syscall_handler(get_current_task()->process, ptr);
     return 0;
 }
+
+void *isr80h_command_12_mmap(struct interrupt_frame *frame)
+{
+    struct task *current_task = get_current_task();
+    uint32_t length = (uint32_t)task_get_stack_item(current_task, 0);
+    uint32_t offset = (uint32_t)task_get_stack_item(current_task, 1);
+    int fd = (int)task_get_stack_item(current_task, 2);
+
+    int file = file_table_get(&current_task->process->files, fd);
+    if (file < 0)
+        return (void *)file;
+
+    // Only the file's own pages can be mapped, so a mapping never makes the kernel hold more than the file
+    struct file_stat stat;
+    int rc = fstat(file, &stat);
+    if (rc < 0)
+        return (void *)rc;
+    if (offset >= stat.filesize)
+        return (void *)-EINVARG;
+    if (length > stat.filesize - offset)
+        length = stat.filesize - offset;
+
+    return process_mmap(current_task->process, 0, length, file, offset, length, false);
+}
+
+void *isr80h_command_13_munmap(struct interrupt_frame *frame)
+{
+    void *addr = task_get_stack_item(get_current_task(), 0);
+    return (void *)process_munmap(get_current_task()->process, addr);
+}
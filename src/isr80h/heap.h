@@ -7,4 +7,12 @@ void *isr80h_command_4_malloc(struct interrupt_frame *frame);
 
 void *isr80h_command_5_free(struct interrupt_frame *frame);
 
+// mmap - map a file into memory.  Accepts a file descriptor of the calling process, an offset into the file (page aligned)
+// and a length, which is cut short at end-of-file.  The mapping is read-only, and its pages are shared with every other process that maps them.
+// Returns the address of the mapping, or < 0 on failure.
+void *isr80h_command_12_mmap(struct interrupt_frame *frame);
+
+// munmap - unmap a mapping made by mmap.  Accepts the address that mmap returned.  Returns 0 on success or < 0 on failure.
+void *isr80h_command_13_munmap(struct interrupt_frame *frame);
+
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "task/task.h"
 #include "print/print.h"
 #include "keyboard/keyboard.h"
+#include "status.h"
 
 #define MAX_STR_SIZE 1024
 
@@ -14,7 +15,8 @@ void *isr80h_command_1_print(struct interrupt_frame *frame)
 
     char buf[MAX_STR_SIZE];
 
-    copy_string_from_user_task(current_task, user_message, buf, sizeof(buf));
+    if (copy_string_from_user_task(current_task, user_message, buf, sizeof(buf)) < 0)
+        return (void *)-EINVARG;
 
     print(buf);
 
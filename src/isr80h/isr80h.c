@@ -4,6 +4,7 @@
 #include "isr80h/io.h"
 #include "isr80h/heap.h"
 #include "isr80h/process.h"
+#include "isr80h/file.h"
 
 void isr80h_register_commands()
 {
@@ -15,4 +16,10 @@ void isr80h_register_commands()
     isr80h_register_command(SYSTEM_COMMAND_5_FREE, isr80h_command_5_free);
     isr80h_register_command(SYSTEM_COMMAND_6_EXECVE, isr80h_command_6_execve);
     isr80h_register_command(SYSTEM_COMMAND_7_EXIT, isr80h_command_7_exit);
+    isr80h_register_command(SYSTEM_COMMAND_8_OPENDIR, isr80h_command_8_opendir);
+    isr80h_register_command(SYSTEM_COMMAND_9_READDIR, isr80h_command_9_readdir);
+    isr80h_register_command(SYSTEM_COMMAND_10_CLOSE, isr80h_command_10_close);
+    isr80h_register_command(SYSTEM_COMMAND_11_OPEN, isr80h_command_11_open);
+    isr80h_register_command(SYSTEM_COMMAND_12_MMAP, isr80h_command_12_mmap);
+    isr80h_register_command(SYSTEM_COMMAND_13_MUNMAP, isr80h_command_13_munmap);
 }
\ No newline at end of file
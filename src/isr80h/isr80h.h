@@ -12,6 +12,12 @@ enum SystemCalls
     SYSTEM_COMMAND_5_FREE,
     SYSTEM_COMMAND_6_EXECVE,
     SYSTEM_COMMAND_7_EXIT,
+    SYSTEM_COMMAND_8_OPENDIR,
+    SYSTEM_COMMAND_9_READDIR,
+    SYSTEM_COMMAND_10_CLOSE,
+    SYSTEM_COMMAND_11_OPEN,
+    SYSTEM_COMMAND_12_MMAP,
+    SYSTEM_COMMAND_13_MUNMAP,
 };
 
 /* Registers all kernel commands that are defined in isr80h/misc */
@@ -7,6 +7,7 @@
 #include "memory/memory.h"
 #include "disk/disk.h"
 #include "disk/disk_stream.h"
+#include "disk/ramdisk.h"
 #include "fs/pparser.h"
 #include "fs/file.h"
 #include "string/string.h"
@@ -118,6 +119,10 @@ void kernel_main()
 
 	disk_search_and_init();
 
+	/* The RAM disk (if the boot disk has an image for one) comes after the real disks, e.g. as 1:/ when there's one hard disk */
+	if (ramdisk_load(RAMDISK_IMAGE))
+		print("Loaded " RAMDISK_IMAGE " into a RAM disk\n");
+
 	idt_init();
 
 	/* Load the task register with segment selector for tss */
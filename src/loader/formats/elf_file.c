@@ -69,20 +69,6 @@ bool valid_elf_file(struct elf32_ehdr *header)
         && elf_has_program_header_table(header);
 }
 
-// Returns a pointer to the section header table
-struct elf32_shdr *elf_get_shdr_table(struct elf32_ehdr *header)
-{
-    struct elf32_shdr *shdr_table = (struct elf32_shdr *)((char *)header + header->e_shoff);
-    return shdr_table;
-}
-
-// Returns the section header at the specified index in the section header table.
-struct elf32_shdr *elf_get_shdr(struct elf32_ehdr *header, unsigned int index)
-{
-    struct elf32_shdr *shdr = elf_get_shdr_table(header);
-    return &shdr[index];
-}
-
 struct elf32_phdr *elf_get_phdr_table(struct elf32_ehdr *header)
 {
     if (!elf_has_program_header_table(header))
@@ -98,24 +84,12 @@ struct elf32_phdr *elf_get_phdr(struct elf32_ehdr *header, unsigned int index)
     return &phdr[index];
 }
 
-// Returns a character pointer to the string table.
-char *elf_get_string_table(struct elf32_ehdr *header)
-{
-    struct elf32_shdr *string_table_section = elf_get_shdr(header, header->e_shstrndx);     // SHT_STRTAB
-    return (char *)header + string_table_section->sh_offset;
-}
-
 ///////////////////////////////////////////////////////////////////
 
-void *elf_file_get_segment_phys_addr(struct elf_file *elf_file, struct elf32_phdr *elf32_phdr)
-{
-    return elf_file->elf_file_buffer + elf32_phdr->p_offset;
-}
-
 /* Process a program header of type PT_LOAD (loadable segment)
  * Expects that PT_LOAD segments are contiguous and that the first segment is executable + contains the code section.
  * 
- * This function calculates the virtual address and physical addresses that the ELF file's loadable segments will be loaded into.
+ * This function calculates the virtual address range that the ELF file's loadable segments will be loaded into,
  * and updates the elf_file structure accordingly.
  */
 int elf_process_pheader_pt_load(struct elf_file *elf_file, struct elf32_phdr *elf32_phdr)
@@ -125,16 +99,12 @@ int elf_process_pheader_pt_load(struct elf_file *elf_file, struct elf32_phdr *el
     if (elf32_phdr->p_type != PT_LOAD)
         return -EINVARG;
 
-    if (elf_file->elf_virtual_addr_base >= (void *)elf32_phdr->p_vaddr || elf_file->elf_virtual_addr_base == 0x00) {
+    if (elf_file->elf_virtual_addr_base >= (void *)elf32_phdr->p_vaddr || elf_file->elf_virtual_addr_base == 0x00)
         elf_file->elf_virtual_addr_base = (void *)elf32_phdr->p_vaddr;
-        elf_file->elf_phys_addr_base = elf_file->elf_file_buffer + elf32_phdr->p_offset;
-    }
 
     unsigned int end_virt_addr = elf32_phdr->p_vaddr + elf32_phdr->p_filesz;
-    if (elf_file->elf_virtual_addr_end <= (void *)end_virt_addr || elf_file->elf_virtual_addr_end == 0x00) {
+    if (elf_file->elf_virtual_addr_end <= (void *)end_virt_addr || elf_file->elf_virtual_addr_end == 0x00)
         elf_file->elf_virtual_addr_end = (void *)end_virt_addr;
-        elf_file->elf_phys_addr_end = elf_file->elf_file_buffer + elf32_phdr->p_offset + elf32_phdr->p_filesz;
-    }
 
     return 0;
 }
@@ -163,7 +133,7 @@ int elf_process_pheaders(struct elf_file *elf_file)
 {
     struct elf32_ehdr *elf32_ehdr = elf_get_ehdr(elf_file);
     for (int i = 0; i < elf32_ehdr->e_phnum; i++) {
-        struct elf32_phdr *elf32_phdr = elf_get_phdr_table(elf32_ehdr);
+        struct elf32_phdr *elf32_phdr = elf_get_phdr(elf32_ehdr, i);
         int rc = elf_process_pheader(elf_file, elf32_phdr);
         if (rc < 0) {
             print("ERROR: elf_process_pheaders: Failed to process a program header\n");
@@ -193,10 +163,38 @@ int process_elf_file(struct elf_file *elf_file)
     return 0;
 }
 
-int elf_file_init(const char *elf_filename, struct elf_file **elf_file_out)
+/* Reads the start of the ELF file, up to the end of the program header table, into elf_file_buffer.
+ * Returns 0 on success, -EIFORMAT if the file isn't an ELF file that we can load, or < 0 on other failures.
+ */
+static int elf_file_read_headers(struct elf_file *elf_file)
 {
-    // Life would be much easier if we had a `mmap` function which maps files into memory
+    struct file_stat stat;
+    int rc = fstat(elf_file->fd, &stat);
+    if (rc < 0)
+        return rc;
 
+    struct elf32_ehdr header;
+    if (stat.filesize < sizeof(header) || fread(&header, sizeof(header), 1, elf_file->fd) != 1 || !valid_elf_file(&header))
+        return -EIFORMAT;
+
+    uint32_t headers_size = header.e_phoff + header.e_phnum * sizeof(struct elf32_phdr);
+    if (headers_size < header.e_phoff || headers_size > stat.filesize)
+        return -EIFORMAT;
+
+    elf_file->elf_file_buffer = kzalloc(headers_size);
+    if (!elf_file->elf_file_buffer)
+        return -ENOMEM;
+
+    if (fseek(elf_file->fd, 0, SEEK_SET) < 0 || fread(elf_file->elf_file_buffer, headers_size, 1, elf_file->fd) != 1) {
+        print("elf_file_init: error reading elf file headers into elf_file_buffer\n");
+        return -EIO;
+    }
+
+    return 0;
+}
+
+int elf_file_init(const char *elf_filename, struct elf_file **elf_file_out)
+{
     struct elf_file *elf_file = kzalloc(sizeof(struct elf_file));
     if (!elf_file)
         return -ENOMEM;
@@ -206,33 +204,18 @@ int elf_file_init(const char *elf_filename, struct elf_file **elf_file_out)
         kfree(elf_file);
         return fd;
     }
+    elf_file->fd = fd;
 
-    struct file_stat stat;
-    int rc = fstat(fd, &stat);
-    if (rc < 0) {
-        kfree(elf_file);
-        return rc;
-    }
-
-    elf_file->elf_file_buffer = kzalloc(stat.filesize);
-    rc = fread(elf_file->elf_file_buffer, stat.filesize, 1, fd);
-    if (rc != 1) {
-        print("elf_file_init: error reading elf file into elf_file_buffer\n");
-        kfree(elf_file->elf_file_buffer);
-        kfree(elf_file);
-        return -EINVARG;
-    }
+    int rc = elf_file_read_headers(elf_file);
+    if (rc == 0)
+        rc = process_elf_file(elf_file);
 
-    rc = process_elf_file(elf_file);
     if (rc < 0) {
-        kfree(elf_file->elf_file_buffer);
-        kfree(elf_file);
-        fclose(fd);
+        elf_file_close(elf_file);
         return rc;
     }
 
     *elf_file_out = elf_file;
-    fclose(fd);
     return 0;
 }
 
@@ -241,6 +224,8 @@ void elf_file_close(struct elf_file *elf_file)
     if (!elf_file)
         return;
 
-    kfree(elf_file->elf_file_buffer);
+    if (elf_file->elf_file_buffer)
+        kfree(elf_file->elf_file_buffer);
+    fclose(elf_file->fd);
     kfree(elf_file);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@ section .asm
 
 global paging_load_pgd
 global enable_paging
+global paging_get_fault_address
 
 paging_load_pgd:
         push ebp                        ; save the caller's base pointer
@@ -23,5 +24,14 @@ enable_paging:
         or eax, 0x80000000              ; set the paging bit in cr0 so that paging is enabled
         mov cr0, eax
 
+        pop ebp			        ; set ebp to caller's frame pointer value
+	ret			        ; return control to caller
+
+paging_get_fault_address:
+        push ebp                        ; save the caller's base pointer
+        mov ebp, esp                    ; set up this function's stack frame by setting it's frame pointer to the current stack bottom (stack grows down)
+
+        mov eax, cr2                    ; the processor puts the address that caused a page fault in cr2.  C functions return values in eax.
+
         pop ebp			        ; set ebp to caller's frame pointer value
 	ret			        ; return control to caller
\ No newline at end of file
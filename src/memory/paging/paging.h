@@ -14,6 +14,11 @@
 #define PGD_ENTRY_TABLE_ADDR    0xfffff000              
 #define PTE_PAGE_FRAME_ADDR     0xfffff000
 
+/* Bitmasks for the error code that the processor pushes for a page fault */
+#define PAGING_FAULT_PRESENT    0b00000001              // 0 = the page wasn't present. 1 = the access wasn't allowed.
+#define PAGING_FAULT_WRITE      0b00000010              // The access was a write
+#define PAGING_FAULT_USER       0b00000100              // The access was made in user mode
+
 /* the page directory and page tables will each have 1024 entries (covers 4 gb address space) */
 #define PAGING_TABLE_ENTRIES    1024                    
 #define PAGING_DIR_ENTRIES      1024
@@ -56,6 +61,9 @@ void paging_switch(struct paging_desc *paging_desc);
  */
 void enable_paging();
 
+/* Returns the address whose access caused the last page fault (cr2) */
+void *paging_get_fault_address();
+
 /* Determines which page global directory entry and corresponding table entry are responsible for the virtual address  
  * Sets directory_index_out and table_index_out as a side effect of function call 
  */
@@ -0,0 +1,77 @@
+#include "pci.h"
+#include "io/io.h"
+#include "status.h"
+
+#define PCI_CONFIG_ADDRESS      0x0CF8
+#define PCI_CONFIG_DATA         0x0CFC
+#define PCI_CONFIG_ENABLE       0x80000000                      // Bit 31 of the address enables the configuration cycle
+
+#define PCI_HEADER_MULTIFUNCTION 0x80                           // Header type bit 7 is set if the device has functions other than 0
+
+static uint32_t pci_config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+        return PCI_CONFIG_ENABLE | ((uint32_t)bus << 16) | ((uint32_t)(slot & 0x1F) << 11) | 
+               ((uint32_t)(function & 0x07) << 8) | (offset & 0xFC);
+}
+
+static uint32_t pci_config_read_at(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+        outl(PCI_CONFIG_ADDRESS, pci_config_address(bus, slot, function, offset));
+        return insl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_config_read(struct pci_device *device, uint8_t offset)
+{
+        return pci_config_read_at(device->bus, device->slot, device->function, offset);
+}
+
+void pci_config_write(struct pci_device *device, uint8_t offset, uint32_t value)
+{
+        outl(PCI_CONFIG_ADDRESS, pci_config_address(device->bus, device->slot, device->function, offset));
+        outl(PCI_CONFIG_DATA, value);
+}
+
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device *device)
+{
+        for (int bus = 0; bus < PCI_MAX_BUSES; bus++) {
+                for (int slot = 0; slot < PCI_MAX_SLOTS; slot++) {
+                        for (int function = 0; function < PCI_MAX_FUNCTIONS; function++) {
+                                uint32_t id = pci_config_read_at(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+                                if ((id & 0xFFFF) == PCI_VENDOR_NONE) {
+                                        if (function == 0)
+                                                break;          // No device in this slot
+                                        continue;
+                                }
+
+                                if ((id & 0xFFFF) == vendor_id && (id >> 16) == device_id && index-- == 0) {
+                                        device->bus = bus;
+                                        device->slot = slot;
+                                        device->function = function;
+                                        device->vendor_id = vendor_id;
+                                        device->device_id = device_id;
+                                        return 0;
+                                }
+
+                                /* Only multifunction devices implement functions 1 - 7 */
+                                uint32_t header = pci_config_read_at(bus, slot, function, PCI_CONFIG_HEADER_TYPE);
+                                if (function == 0 && !((header >> 16) & PCI_HEADER_MULTIFUNCTION))
+                                        break;
+                        }
+                }
+        }
+
+        return -EIO;
+}
+
+uint32_t pci_read_bar(struct pci_device *device, int bar)
+{
+        return pci_config_read(device, PCI_CONFIG_BAR0 + bar * 4);
+}
+
+void pci_enable(struct pci_device *device, uint16_t command_bits)
+{
+        uint32_t command = pci_config_read(device, PCI_CONFIG_COMMAND);
+
+        /* The upper half is the status register, whose bits are cleared by writing ones */
+        pci_config_write(device, PCI_CONFIG_COMMAND, (command & 0xFFFF) | command_bits);
+}
@@ -0,0 +1,60 @@
+/* pci.h
+ *
+ * Access to PCI configuration space through configuration mechanism #1 (ports 0xCF8 and 0xCFC).
+ * Devices are addressed by bus, slot (device number), and function.
+ */
+
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_MAX_BUSES           256
+#define PCI_MAX_SLOTS           32
+#define PCI_MAX_FUNCTIONS       8
+
+/* Offsets of configuration space registers in the common header */
+#define PCI_CONFIG_VENDOR_ID    0x00
+#define PCI_CONFIG_DEVICE_ID    0x02
+#define PCI_CONFIG_COMMAND      0x04
+#define PCI_CONFIG_HEADER_TYPE  0x0E
+#define PCI_CONFIG_BAR0         0x10
+
+/* Command register bits */
+#define PCI_COMMAND_IO_SPACE    0x0001                          // Respond to I/O space accesses
+#define PCI_COMMAND_BUS_MASTER  0x0004                          // Allow the device to access memory (DMA)
+
+#define PCI_BAR_IO_SPACE        0x01                            // Bit 0 of a BAR is set if it maps I/O space
+
+#define PCI_VENDOR_NONE         0xFFFF                          // Reads of a function that doesn't exist return all ones
+
+struct pci_device {
+        uint8_t bus;
+        uint8_t slot;
+        uint8_t function;
+        uint16_t vendor_id;
+        uint16_t device_id;
+};
+
+/* Read the 32-bit configuration register at offset (rounded down to a multiple of 4) of the device's function */
+uint32_t pci_config_read(struct pci_device *device, uint8_t offset);
+
+/* Write the 32-bit configuration register at offset (rounded down to a multiple of 4) of the device's function */
+void pci_config_write(struct pci_device *device, uint8_t offset, uint32_t value);
+
+/* pci_find_device
+ * Scans every bus for functions with the given vendor and device ids.
+ * index - which of the matching functions to return, in scan order (0 = the first one)
+ * device - filled in with the matching function
+ *
+ * Returns 0 on success or -EIO if there are no more than index matching functions
+ */
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device *device);
+
+/* Returns the value of base address register bar (0 - 5) of device */
+uint32_t pci_read_bar(struct pci_device *device, int bar);
+
+/* Set bits in the device's command register (e.g. PCI_COMMAND_BUS_MASTER) */
+void pci_enable(struct pci_device *device, uint16_t command_bits);
+
+#endif
@@ -11,6 +11,8 @@
 #define EUNIMP          7
 #define EISTAKEN        8
 #define EIFORMAT        9   // Invalid format
+#define ENOSPC          10  // No space left on the disk
+#define EBUSY           11  // The file is in use
 
 #define FALSE		    0
 #define TRUE		    1
@@ -26,6 +26,7 @@ static struct process *processes[MAX_PROCESSES];
 static void process_init(struct process *process)
 {
     memset(process, 0, sizeof(struct process));
+    file_table_init(&process->files);
 }
 
 struct process *get_current_process()
@@ -113,12 +114,14 @@ static int process_map_task_binary(struct process *process)
 }
 
 /* Maps the process's ELF file's loadable segments into the page tables of the process's tasks.
- * 
+ *
+ * Each segment is a memory mapping of the ELF file (see process_mmap), so its pages are only read when the program
+ * touches them.  Read-only segments (e.g. code) are shared with every other process running the same program.
+ * The part of a segment that's past the end of its data in the file (p_memsz > p_filesz, e.g. .bss) reads as zeros.
  */
 static int process_map_task_elf(struct process *process)
 {
     struct elf_file *elf_file = process->elf_file;
-    int rc = 0;
 
     // Loop through the program headers
     struct elf32_ehdr *elf32_ehdr = elf_get_ehdr(elf_file);
@@ -126,19 +129,22 @@ static int process_map_task_elf(struct process *process)
     
     for (int i = 0; i < elf32_ehdr->e_phnum; i++) {
         struct elf32_phdr *phdr = &phdr_table[i];
-        void *phdr_phys_addr = elf_file_get_segment_phys_addr(elf_file, phdr);
-        int pflags = PAGING_PRESENT | PAGING_USER_SUPERVISOR;
-        if (phdr->p_flags & PF_W) {
-            pflags |= PAGING_READ_WRITE;
-        }
-        
-        rc = paging_create_mapping(process->task->paging, paging_align_to_lower_page((void *)phdr->p_vaddr), paging_align_to_lower_page((void *)phdr_phys_addr),
-                            paging_align_address(phdr_phys_addr+phdr->p_memsz), pflags);
-        if (rc < 0)
-            break;
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+
+        // A segment's offset in the file and its address have to be on the same spot of a page for it to be mapped
+        void *addr = paging_align_to_lower_page((void *)phdr->p_vaddr);
+        uint32_t skip = phdr->p_vaddr - (uint32_t)addr;
+        if (phdr->p_offset % PAGING_PAGE_SIZE != skip || phdr->p_filesz > phdr->p_memsz)
+            return -EIFORMAT;
+
+        void *res = process_mmap(process, addr, skip + phdr->p_memsz, elf_file->fd, phdr->p_offset - skip,
+                                    skip + phdr->p_filesz, phdr->p_flags & PF_W);
+        if (IS_ERROR(res))
+            return ERROR_I(res);
     }
 
-    return rc;
+    return 0;
 }
 
 /* This function maps the process's executable memory (containing executable binary file or elf file), 
@@ -177,9 +183,33 @@ int process_map_task_memory(struct process *process)
     return rc;
 }
 
+/* Frees mapping's private pages and ends its mapping of the file, leaving its slot free.
+ * The page tables aren't touched: the pages must already be unmapped, unless the process is being freed.
+ */
+static void process_mapping_release(struct process_mapping *mapping)
+{
+    if (mapping->private_pages) {
+        for (uint32_t i = 0; i < mapping->pages; i++) {
+            if (mapping->private_pages[i])
+                kfree(mapping->private_pages[i]);
+        }
+        kfree(mapping->private_pages);
+    }
+
+    funmap(mapping->file);
+    memset(mapping, 0, sizeof(struct process_mapping));
+}
+
 /* Free the kernel heap memory allocated for and by the process */
 void process_free(struct process *process)
 {
+    // Unmap memory mapped files first, since the ELF file's segments are mapped from it.
+    // Like the allocations below, they don't need to be unlinked from the process's page tables.
+    for (int i = 0; i < PROCESS_MAX_MAPPINGS; i++) {
+        if (process->mappings[i].addr)
+            process_mapping_release(&process->mappings[i]);
+    }
+
     switch (process->format)
     {
         case ELF:
@@ -208,6 +238,8 @@ void process_free(struct process *process)
             kfree(process->mem_allocs[i].ptr);
         }
     }
+
+    file_table_close_all(&process->files);
 }
 
 // Given an address from the arg block of memory, translate it to its userspace equivalent.
@@ -510,6 +542,166 @@ void process_free_syscall_handler(struct process *process, void *ptr)
     allocation->size = 0;
 }
 
+// Returns the mapping of process that overlaps [addr, addr + size), or 0 if there is none
+static struct process_mapping *process_find_mapping(struct process *process, uint32_t addr, uint32_t size)
+{
+    for (int i = 0; i < PROCESS_MAX_MAPPINGS; i++) {
+        struct process_mapping *mapping = &process->mappings[i];
+        uint32_t start = (uint32_t)mapping->addr;
+        if (mapping->addr && addr < start + mapping->pages * PAGING_PAGE_SIZE && start < addr + size)
+            return mapping;
+    }
+
+    return 0;
+}
+
+// Returns the first size bytes between PROCESS_MMAP_VIRT_ADDR and PROCESS_MMAP_VIRT_ADDR_END that aren't mapped, or 0 if there's no room
+static void *process_mmap_find_space(struct process *process, uint32_t size)
+{
+    uint32_t addr = PROCESS_MMAP_VIRT_ADDR;
+    struct process_mapping *mapping;
+    while (addr < PROCESS_MMAP_VIRT_ADDR_END && (mapping = process_find_mapping(process, addr, size)))
+        addr = (uint32_t)mapping->addr + mapping->pages * PAGING_PAGE_SIZE;
+
+    if (size > PROCESS_MMAP_VIRT_ADDR_END - PROCESS_MMAP_VIRT_ADDR || addr > PROCESS_MMAP_VIRT_ADDR_END - size)
+        return 0;
+
+    return (void *)addr;
+}
+
+/* Returns true if page of mapping has to be the process's own copy instead of the page cache's page, because it can be
+ * written or because part of it has to read as zeros instead of the file's data
+ */
+static bool process_mapping_page_is_private(struct process_mapping *mapping, uint32_t page)
+{
+    return mapping->writable || (mapping->private_pages && page * PAGING_PAGE_SIZE + PAGING_PAGE_SIZE > mapping->file_size);
+}
+
+void *process_mmap(struct process *process, void *addr, uint32_t length, int file, uint32_t offset, uint32_t file_size, bool writable)
+{
+    if (length == 0 || length > 0xFFFFFFFF - PAGING_PAGE_SIZE || file_size > length || !paging_is_aligned(addr)
+            || offset % PAGING_PAGE_SIZE != 0)
+        return ERROR(-EINVARG);
+
+    uint32_t pages = (length + PAGING_PAGE_SIZE - 1) / PAGING_PAGE_SIZE;
+    uint32_t size = pages * PAGING_PAGE_SIZE;
+    if (!addr) {
+        addr = process_mmap_find_space(process, size);
+        if (!addr)
+            return ERROR(-ENOMEM);
+    } else if ((uint32_t)addr > 0xFFFFFFFF - size) {
+        return ERROR(-EINVARG);
+    } else if (process_find_mapping(process, (uint32_t)addr, size)) {
+        return ERROR(-EISTAKEN);
+    }
+
+    struct process_mapping *mapping = 0;
+    for (int i = 0; i < PROCESS_MAX_MAPPINGS && !mapping; i++) {
+        if (!process->mappings[i].addr)
+            mapping = &process->mappings[i];
+    }
+    if (!mapping)
+        return ERROR(-ENOMEM);
+
+    // Whatever of the mapping lies past end-of-file reads as zeros from the process's own pages, not the page cache's
+    struct file_stat stat;
+    int rc = fstat(file, &stat);
+    if (rc < 0)
+        return ERROR(rc);
+    if (offset >= stat.filesize)
+        file_size = 0;
+    else if (file_size > stat.filesize - offset)
+        file_size = stat.filesize - offset;
+
+    int map_file = fmap(file);
+    if (map_file < 0)
+        return ERROR(map_file);
+
+    void **private_pages = 0;
+    if (writable || file_size < length) {
+        private_pages = kzalloc(pages * sizeof(void *));
+        if (!private_pages) {
+            funmap(map_file);
+            return ERROR(-ENOMEM);
+        }
+    }
+
+    // Nothing is mapped until it's touched
+    for (uint32_t i = 0; i < pages; i++)
+        paging_set(process->task->paging->pgd, addr + i * PAGING_PAGE_SIZE, 0);
+
+    mapping->addr = addr;
+    mapping->pages = pages;
+    mapping->file = map_file;
+    mapping->file_page = offset / PAGING_PAGE_SIZE;
+    mapping->file_size = file_size;
+    mapping->writable = writable;
+    mapping->private_pages = private_pages;
+    return addr;
+}
+
+int process_munmap(struct process *process, void *addr)
+{
+    struct process_mapping *mapping = process_find_mapping(process, (uint32_t)addr, 1);
+    if (!mapping || mapping->addr != addr)
+        return -EINVARG;
+
+    // Go back to the read-only 1:1 mapping that the rest of the task's address space has
+    int rc = paging_create_mapping(process->task->paging, addr, addr, addr + mapping->pages * PAGING_PAGE_SIZE,
+                                    PAGING_USER_SUPERVISOR | PAGING_PRESENT);
+    if (rc < 0)
+        return rc;
+
+    process_mapping_release(mapping);
+    return 0;
+}
+
+int process_handle_page_fault(struct process *process, void *addr, uint32_t error_code)
+{
+    // Only pages that haven't been mapped in yet can be fixed.  E.g. a write to a read-only page is the process's own fault.
+    if (error_code & PAGING_FAULT_PRESENT)
+        return -EINVARG;
+
+    struct process_mapping *mapping = process_find_mapping(process, (uint32_t)addr, 1);
+    if (!mapping)
+        return -EINVARG;
+
+    uint32_t page = ((uint32_t)addr - (uint32_t)mapping->addr) / PAGING_PAGE_SIZE;
+    uint32_t offset = page * PAGING_PAGE_SIZE;
+    int flags = PAGING_PRESENT | PAGING_USER_SUPERVISOR;
+    void *data = 0;
+    int rc = 0;
+
+    if (!process_mapping_page_is_private(mapping, page)) {
+        // The page cache's page is mapped into every process that maps this page of the file, so it's never writable
+        rc = fmap_page(mapping->file, mapping->file_page + page, &data);
+        if (rc < 0)
+            return rc;
+    } else {
+        data = kzalloc(PAGING_PAGE_SIZE);
+        if (!data)
+            return -ENOMEM;
+
+        if (offset < mapping->file_size) {
+            void *file_data = 0;
+            rc = fmap_page(mapping->file, mapping->file_page + page, &file_data);
+            if (rc < 0) {
+                kfree(data);
+                return rc;
+            }
+
+            uint32_t n = mapping->file_size - offset < PAGING_PAGE_SIZE ? mapping->file_size - offset : PAGING_PAGE_SIZE;
+            memcpy(data, file_data, n);
+        }
+
+        mapping->private_pages[page] = data;
+        if (mapping->writable)
+            flags |= PAGING_READ_WRITE;
+    }
+
+    return paging_set(process->task->paging->pgd, mapping->addr + offset, (uint32_t)data | flags);
+}
+
 int process_terminate(struct process *process)
 {
     process_free(process);
@@ -3,10 +3,12 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "task/task.h"
 #include "config.h"
 #include "keyboard/keyboard.h"
 #include "loader/formats/elf_file.h"
+#include "fs/file.h"
 
 #define MAX_CMMD_ARG_LEN 32
 
@@ -28,6 +30,32 @@ struct process_mem_allocation {
     size_t size;
 };
 
+/* Tracks a file (or part of one) that's mapped into a process's address space.
+ * The mapping's page table entries start out not present, and each page is mapped when the process first touches it
+ * (see process_handle_page_fault).  Read-only pages are the page cache's own pages, so every process that maps the
+ * same file shares them.  Pages that can be written, or that are partly past the part of the file that's mapped, are
+ * private copies.
+ */
+struct process_mapping {
+    // Page aligned address of the mapping in the process's address space, or 0 if this slot is free
+    void *addr;
+
+    // # of pages mapped
+    uint32_t pages;
+
+    // Open file (from fmap) that the pages are read from, and the page of it that's mapped at addr
+    int file;
+    uint32_t file_page;
+
+    // # of bytes from addr on that come from the file.  The rest of the mapping reads as zeros (e.g. an ELF segment's .bss).
+    uint32_t file_size;
+
+    bool writable;
+
+    // The private copy of each page, or 0 if it hasn't been made yet.  Only allocated if the mapping has private pages.
+    void **private_pages;
+};
+
 /* 
  * We're using this concept of processes to encapsulate tasks (i.e. threads).
  * Linux kernel uses the concept of lightweight threads which are still task_struct instances.
@@ -57,6 +85,12 @@ struct process {
      */
     struct process_mem_allocation mem_allocs[PROCESS_MAX_ALLOCATIONS];
 
+    // Memory mapped files, including the loadable segments of the process's ELF file
+    struct process_mapping mappings[PROCESS_MAX_MAPPINGS];
+
+    /* The process's own file descriptors.  Whatever the process leaves open is closed when it terminates. */
+    struct file_table files;
+
     /* The pointer to the memory that the process executable is loaded into.
      * If the process is instantiated from an ELF file, then elf_file will be set. 
      * If the process is instantiated from a binary executable, then binary_executable will be set.
@@ -130,6 +164,25 @@ void *process_malloc_syscall_handler(struct process *process, size_t size);
 
 void process_free_syscall_handler(struct process *process, void *ptr);
 
+/* Maps length bytes of file (an open file, e.g. from fopen), starting at offset (which must be page aligned),
+ * into the address space of process's task at addr.  If addr is 0, the mapping goes in the first free space between
+ * PROCESS_MMAP_VIRT_ADDR and PROCESS_MMAP_VIRT_ADDR_END.
+ * Only the first file_size bytes (at most length, and cut short at end-of-file) come from the file: the rest of the mapping reads as zeros.
+ * Pages are read from the file when they're first touched.  The file can be closed afterwards, since the mapping keeps its own.
+ *
+ * Returns the address of the mapping, or < 0 on failure (-EISTAKEN if addr overlaps another mapping).
+ */
+void *process_mmap(struct process *process, void *addr, uint32_t length, int file, uint32_t offset, uint32_t file_size, bool writable);
+
+/* Unmaps the mapping of process that starts at addr.  Returns 0 on success or < 0 on failure */
+int process_munmap(struct process *process, void *addr);
+
+/* Maps in the page of a memory mapped file that addr is on, after process's task faulted on it.
+ * error_code is the page fault's error code (see PAGING_FAULT_* in paging.h).
+ * Returns 0 if the faulting access can be retried, or < 0 if the fault isn't for a mapped page or the page can't be read.
+ */
+int process_handle_page_fault(struct process *process, void *addr, uint32_t error_code);
+
 // argv and the corresponding strings must be dynamically allocated on the kernel heap
 int process_load_with_args(const char *filename, struct process **process, int argc, char *argv[]);
 
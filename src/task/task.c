@@ -184,49 +184,121 @@ void task_current_save_state(struct interrupt_frame *frame)
 }
 
 
+/* Returns the page table entry of page in task's page tables, if userland can access the page with flags
+ * (PAGING_PRESENT | PAGING_USER_SUPERVISOR, and PAGING_READ_WRITE to write to it).
+ * A page of a memory mapped file that the task hasn't touched yet is mapped in first, as if the task had accessed it.
+ * Returns 0 if the task can't access the page that way.
+ */
+static uint32_t task_get_user_pte(struct task *task, void *page, uint32_t flags)
+{
+    uint32_t *task_page_directory = task->paging->pgd;
+    uint32_t pgd_index = 0;
+    uint32_t table_index = 0;
+    if (paging_get_indexes(page, &pgd_index, &table_index) < 0)
+        return 0;
+
+    uint32_t pte = task_page_directory[pgd_index] & PAGING_PRESENT ? paging_get_pte(task_page_directory, page) : 0;
+    if (!(pte & PAGING_PRESENT)) {
+        uint32_t error_code = PAGING_FAULT_USER | (flags & PAGING_READ_WRITE ? PAGING_FAULT_WRITE : 0);
+        if (!task->process || process_handle_page_fault(task->process, page, error_code) < 0)
+            return 0;
+        pte = paging_get_pte(task_page_directory, page);
+    }
+
+    return (pte & flags) == flags ? pte : 0;
+}
+
 int copy_string_from_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int max)
 {
-    if (max >= PAGING_PAGE_SIZE)
-        return -EINVARG;
+    char *src = task_virt_addr;
+    char *dest = kernel_virt_addr;
 
-    /* Allocate memory that we can share between userland and kernel land.
-     * The kernel can access the memory at address tmp, which is a physical address due to kernel linear page table mapping.
-     * However, we will need to map the physical address tmp into the task's page tables,
-     * so that we have a way to access the same physical memory from task land and kernel land. 
+    /* Like copy_to_user_task, the string is read a page at a time through the pages' physical addresses,
+     * so a page that the task can't read fails the copy rather than faulting in the kernel.
      */
-    char *tmp = kzalloc(max);
-    if (!tmp)
-        return -ENOMEM;
+    while (max > 0) {
+        void *page = paging_align_to_lower_page(src);
+        uint32_t pte = task_get_user_pte(task, page, PAGING_PRESENT | PAGING_USER_SUPERVISOR);
+        if (!pte)
+            return -EINVARG;
+
+        int offset = src - (char *)page;
+        int n = PAGING_PAGE_SIZE - offset < max ? PAGING_PAGE_SIZE - offset : max;
+        char *from = (char *)(pte & PGD_ENTRY_TABLE_ADDR) + offset;
+        for (int i = 0; i < n; i++) {
+            dest[i] = from[i];
+            if (!from[i])
+                return 0;
+        }
+
+        src += n;
+        dest += n;
+        max -= n;
+    }
 
-    uint32_t *task_page_directory = task->paging->pgd;
+    return 0;
+}
 
-    /* Get the page table entry in task's page tables that corresponds to tmp.
-     * Since we will be temporarily remapping this page table entry, we will want to replace it
-     * once we're done so that the task does not lose access to the virtual address mapping in case it was being used.
-     */
-    uint32_t old_entry = paging_get_pte(task_page_directory, tmp);
+int copy_from_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int size)
+{
+    char *src = task_virt_addr;
+    char *dest = kernel_virt_addr;
+
+    while (size > 0) {
+        void *page = paging_align_to_lower_page(src);
+        uint32_t pte = task_get_user_pte(task, page, PAGING_PRESENT | PAGING_USER_SUPERVISOR);
+        if (!pte)
+            return -EINVARG;
+
+        int offset = src - (char *)page;
+        int n = PAGING_PAGE_SIZE - offset < size ? PAGING_PAGE_SIZE - offset : size;
+        memcpy(dest, (char *)(pte & PGD_ENTRY_TABLE_ADDR) + offset, n);
+
+        src += n;
+        dest += n;
+        size -= n;
+    }
 
-    /* Map the physical address tmp to virtual address tmp within the task's page tables. */
-    paging_map_range(task->paging, tmp, tmp, 1, PAGING_READ_WRITE | PAGING_PRESENT | PAGING_USER_SUPERVISOR);
-    
-    /* Switch to the task's page tables.
-     * Now, we can access the value at task_virt_addr.
-     */
-    paging_switch(task->paging);
+    return 0;
+}
 
-    /* Copy the string at task_virt_addr to tmp. */
-    strncpy(tmp, task_virt_addr, max);
+int task_prepare_user_buffer(struct task *task, void *task_virt_addr, int size)
+{
+    uint32_t start = (uint32_t)task_virt_addr;
+    if (size < 0 || start + size < start)
+        return -EINVARG;
 
-    /* Switch back to kernel page tables */
-    swap_kernel_page_tables();
+    for (uint32_t page = start & ~(PAGING_PAGE_SIZE - 1); page < start + size; page += PAGING_PAGE_SIZE) {
+        if (!task_get_user_pte(task, (void *)page, PAGING_PRESENT | PAGING_READ_WRITE | PAGING_USER_SUPERVISOR))
+            return -EINVARG;
+    }
 
-    /* Restore task's page tables so that it can see whatever was at tmp before we overwrote it */
-    if (paging_set(task_page_directory, tmp, old_entry) < 0) {
-        kfree(tmp);
-        return -EIO;
+    return 0;
+}
+
+int copy_to_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int size)
+{
+    char *dest = task_virt_addr;
+    char *src = kernel_virt_addr;
+
+    /* Pages that are next to each other in the task's address space needn't be next to each other in physical memory,
+     * so copy a page at a time.  Each page's physical address is also its kernel virtual address.
+     */
+    while (size > 0) {
+        void *page = paging_align_to_lower_page(dest);
+        uint32_t pte = task_get_user_pte(task, page, PAGING_PRESENT | PAGING_READ_WRITE | PAGING_USER_SUPERVISOR);
+        if (!pte)
+            return -EINVARG;
+
+        int offset = dest - (char *)page;
+        int n = PAGING_PAGE_SIZE - offset < size ? PAGING_PAGE_SIZE - offset : size;
+        memcpy((char *)(pte & PGD_ENTRY_TABLE_ADDR) + offset, src, n);
+
+        dest += n;
+        src += n;
+        size -= n;
     }
 
-    strncpy(kernel_virt_addr, tmp, max);
     return 0;
 }
 
@@ -92,20 +92,42 @@ void task_current_save_state(struct interrupt_frame *frame);
 
 /* Copy a string from userland (task's address space) to the kernel's address space.
  * This function must be called from kernel land.
- * This function relies on the fact that the kernel page table's linearly map the entire physical address space.
+ * Like copy_to_user_task, each page of the string is looked up in task's page tables and read through its physical address,
+ * which the kernel page tables map linearly.
  *
- *  task_virt_addr - A userland virtual address that is mapped to some value via task's page tables.  
- *                   Kernel mode code cannot directly see the value at this address since it is mapped to a physical address
- *                   by task's page tables, and not the kernel's page tables.
- * 
- *  kernel_virt_addr - Kernel virtual address (mapped by kernel page tables).  We map the userland value at task_virt_addr
- *                     into kernel_virt_addr so that the kernel can access the value.
- * 
- *   max - The maximum length of the string that we are copying from userland to kernel land.
+ *  task_virt_addr - Where the string is in task's address space.  Pages of memory mappings that the task hasn't touched yet are mapped in first.
+ *  kernel_virt_addr - Kernel virtual address that the string is copied to.
+ *  max - The maximum # of bytes to copy, including the terminating null byte (which isn't added if the string doesn't end within max bytes).
  *
+ * Returns 0 on success, or -EINVARG if part of the string isn't readable by the task.
  */
 int copy_string_from_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int max);
 
+/* Copy size bytes from userland (task's address space) to the kernel's address space, the same way as copy_string_from_user_task.
+ * Returns 0 on success, or -EINVARG if part of the source isn't readable by the task.
+ */
+int copy_from_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int size);
+
+/* Copy size bytes from the kernel's address space to userland (task's address space).
+ * This function must be called from kernel land.
+ * Rather than switching page tables, each page of the destination is looked up in task's page tables, and the bytes are written
+ * straight to its physical address, which the kernel page tables map linearly.
+ *
+ *  task_virt_addr - Where the bytes go.  Every page in the range must be mapped writable for userland in task's page tables,
+ *                   or be part of a writable memory mapping of the task's process, in which case it's mapped in first.
+ *  kernel_virt_addr - Kernel virtual address of the bytes to copy.
+ *
+ * Returns 0 on success, or -EINVARG if part of the destination isn't writable by the task (nothing after that part is copied).
+ */
+int copy_to_user_task(struct task *task, void *task_virt_addr, void *kernel_virt_addr, int size);
+
+/* Checks that copy_to_user_task can write all size bytes at task_virt_addr, mapping in any pages of the range that are
+ * part of a memory mapping but haven't been touched yet.  System calls that consume something (e.g. directory entries)
+ * call this first, so that a bad buffer doesn't lose what they consumed.
+ * Returns 0 on success, or -EINVARG if part of the range isn't writable by the task.
+ */
+int task_prepare_user_buffer(struct task *task, void *task_virt_addr, int size);
+
 /* Retrieve items from the task's stack.  
  * This function switches into the task's page tables,
  * pulls the stack item at index using the task's saved esp register value,
@@ -84,6 +84,38 @@ struct command_token *parse_command(const char *command, int command_len)
     return root_command;
 }
 
+#define LS_BATCH_ENTRIES 32
+
+// Lists the entries of the directory at path, a batch of entries per system call.
+void list_directory(const char *path)
+{
+    int fd = coniferos_opendir(path);
+    if (fd < 0) {
+        printf("ls: could not open %s\n", path);
+        return;
+    }
+
+    struct coniferos_dirent *entries = malloc(LS_BATCH_ENTRIES * sizeof(struct coniferos_dirent));
+    if (!entries) {
+        printf("shell.c: ERROR: could not allocate memory for directory entries");
+        coniferos_close(fd);
+        return;
+    }
+
+    int count = 0;
+    while ((count = coniferos_readdir(fd, entries, LS_BATCH_ENTRIES)) > 0) {
+        for (int i = 0; i < count; i++) {
+            if (entries[i].type == CONIFEROS_DIRENT_DIRECTORY)
+                printf("%s/\n", entries[i].name);
+            else
+                printf("%s  %i\n", entries[i].name, entries[i].filesize);
+        }
+    }
+
+    free(entries);
+    coniferos_close(fd);
+}
+
 int main(int argc, char **argv) 
 {
     printf("ConiferOS shell v0.0.1\n");
@@ -102,6 +134,12 @@ int main(int argc, char **argv)
 
         struct command_token *root = parse_command(path_buf, MAX_COMMAND_LEN);
 
+        // 'ls' is built into the shell.  It lists the programs (and everything else) in the root directory.
+        if (root && strnicmp(root->token, "0:/ls", sizeof("0:/ls")) == 0) {
+            list_directory(path_prefix);
+            continue;
+        }
+
         int argc = 0;
         const char **argv = create_argv_array(root, &argc);
 
@@ -12,6 +12,12 @@ global coniferos_putchar:function
 global coniferos_exec:function
 global coniferos_execve:function
 global coniferos_exit:function
+global coniferos_opendir:function
+global coniferos_readdir:function
+global coniferos_close:function
+global coniferos_open:function
+global coniferos_mmap:function
+global coniferos_munmap:function
 
 ; void print(const char *filename)
 print:
@@ -108,3 +114,73 @@ coniferos_exit:
     int 0x80
     pop ebp
     ret
+
+; int coniferos_opendir(const char *path)
+coniferos_opendir:
+    push ebp
+    mov ebp, esp
+    mov eax, 8                      ; opendir system call
+    push dword[ebp+8]               ; Push path onto the stack
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int coniferos_readdir(int fd, struct coniferos_dirent *entries, int max)
+coniferos_readdir:
+    push ebp
+    mov ebp, esp
+    mov eax, 9                      ; readdir system call
+    push dword[ebp+8]               ; Push fd onto the stack
+    push dword[ebp+12]              ; Push entries onto the stack
+    push dword[ebp+16]              ; Push max onto the stack
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int coniferos_close(int fd)
+coniferos_close:
+    push ebp
+    mov ebp, esp
+    mov eax, 10                     ; close system call
+    push dword[ebp+8]               ; Push fd onto the stack
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int coniferos_open(const char *path)
+coniferos_open:
+    push ebp
+    mov ebp, esp
+    mov eax, 11                     ; open system call
+    push dword[ebp+8]               ; Push path onto the stack
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; void *coniferos_mmap(int fd, uint32_t offset, uint32_t length)
+coniferos_mmap:
+    push ebp
+    mov ebp, esp
+    mov eax, 12                     ; mmap system call
+    push dword[ebp+8]               ; Push fd onto the stack
+    push dword[ebp+12]              ; Push offset onto the stack
+    push dword[ebp+16]              ; Push length onto the stack
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int coniferos_munmap(void *addr)
+coniferos_munmap:
+    push ebp
+    mov ebp, esp
+    mov eax, 13                     ; munmap system call
+    push dword[ebp+8]               ; Push addr onto the stack
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
@@ -2,6 +2,7 @@
 #define CONIFER_OS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 // C interface to ConiferOS system calls
 
@@ -41,4 +42,45 @@ void coniferos_execve(const char *filename, const char *argv[], const int argc);
 // exit - cause normal process termination
 void coniferos_exit();
 
+#define CONIFEROS_DIRENT_FILE           0
+#define CONIFEROS_DIRENT_DIRECTORY      1
+#define CONIFEROS_DIRENT_NAME_MAX       256
+
+// An entry of a directory.  Must match the kernel's struct dirent.
+struct coniferos_dirent {
+    uint32_t filesize;
+    uint32_t type;                  // CONIFEROS_DIRENT_FILE or CONIFEROS_DIRENT_DIRECTORY
+    char name[CONIFEROS_DIRENT_NAME_MAX];
+};
+
+/* Opens a directory stream on the directory at path (e.g. "0:/").
+ * Returns a file descriptor on success or < 0 on failure.  Close it with coniferos_close.
+ */
+int coniferos_opendir(const char *path);
+
+/* Reads up to max entries of the directory stream fd into entries, with one system call.
+ * The kernel returns at most 32 entries per call.  Call it until it returns 0 to list the whole directory.
+ * Returns the # of entries read, 0 at the end of the directory, or < 0 on failure.
+ */
+int coniferos_readdir(int fd, struct coniferos_dirent *entries, int max);
+
+// close - close a file descriptor.  Returns 0 on success or < 0 on failure.
+int coniferos_close(int fd);
+
+/* Opens the file at path (e.g. "0:/readme.txt") for reading.
+ * Returns a file descriptor on success or < 0 on failure.  Close it with coniferos_close.
+ */
+int coniferos_open(const char *path);
+
+/* Maps length bytes of the file fd, starting at offset (a multiple of 4096), into memory.  The memory is read-only.
+ * The mapping stops at the end of the file (the rest of its last page reads as zeros), and offset must be before the end.
+ * Pages are only read from the file when they're first touched, and are shared with other processes that map the same file.
+ * The file can't be written while it's mapped.  fd can be closed afterwards.
+ * Returns the address of the mapping, or a negative value (cast to a pointer) on failure.  Unmap it with coniferos_munmap.
+ */
+void *coniferos_mmap(int fd, uint32_t offset, uint32_t length);
+
+// munmap - unmap memory mapped by coniferos_mmap.  Returns 0 on success or < 0 on failure.
+int coniferos_munmap(void *addr);
+
 #endif
\ No newline at end of file